@@ -0,0 +1,574 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "shader.h"
+#include "instance_buffer.h"
+#include "mesh.h"
+#include "mesh_pool.h"
+#include "vertex_format.h"
+#include "normal_matrix.h"
+#include "gl_state.h"
+#include "culling.h"
+#include "bvh.h"
+#include "worker_pool.h"
+#include "texture_loader.h"
+#include "ktx_texture.h"
+#include "block_compression.h"
+#include "mipmap.h"
+
+// Microbenchmarks, run with `hello-triangle --bench <name>` once a GL context exists
+
+// Time fn() over a number of iterations and print the average cost per iteration
+template <typename Fn>
+double benchRun(const char *label, int iterations, Fn fn) {
+    // Warm up once so first-call driver work is not measured
+    fn();
+    glFinish();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++)
+        fn();
+    glFinish();
+    auto end = std::chrono::high_resolution_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    std::cout << "  " << label << ": " << ns << " ns/iter" << std::endl;
+    return ns;
+}
+
+// Compares the legacy per-call glGetUniformLocation setters with the cached-location paths,
+// using the per-frame cube loop workload (model + material.shininess for 12 cubes)
+inline void benchUniformSetters(Shader &shader) {
+    const int iterations = 20000;
+    const int cubes = 12;
+    glm::mat4 models[cubes];
+    for (int i = 0; i < cubes; i++)
+        models[i] = glm::translate(glm::mat4(1.0f), glm::vec3((float)i, 2.0f, 3.0f));
+    shader.use();
+
+    std::cout << "Uniform setters (" << cubes << " cubes per iteration)" << std::endl;
+    double legacy = benchRun("glGetUniformLocation per call", iterations, [&]() {
+        for (int i = 0; i < cubes; i++) {
+            glUniformMatrix4fv(glGetUniformLocation(shader.ID, std::string("model").c_str()), 1, GL_FALSE, &models[i][0][0]);
+            glUniform1f(glGetUniformLocation(shader.ID, std::string("material.shininess").c_str()), 64.0f);
+        }
+    });
+    benchRun("string setters (hashed lookup)", iterations, [&]() {
+        for (int i = 0; i < cubes; i++) {
+            shader.setMat4("model", models[i]);
+            shader.setFloat("material.shininess", 64.0f);
+        }
+    });
+    Shader::Uniform uModel = shader.uniform("model");
+    Shader::Uniform uShininess = shader.uniform("material.shininess");
+    Shader::resetUploadStats();
+    double cached = benchRun("cached handles", iterations, [&]() {
+        for (int i = 0; i < cubes; i++) {
+            shader.setMat4(uModel, models[i]);
+            shader.setFloat(uShininess, 64.0f);
+        }
+    });
+    // Redundant shininess sets are skipped by the shadow copy, model changes every call
+    std::cout << "  uploads issued: " << Shader::uploadStats().issued << ", skipped: " << Shader::uploadStats().skipped << std::endl;
+    std::cout << "  speedup: " << legacy / cached << "x" << std::endl;
+}
+
+// Compares the per-cube loop (model + normalMatrix uniforms and a draw per cube) with one
+// instanced draw, at scene sizes from the demo's 12 cubes up to a million. vertexArray must
+// have mesh attached. The instanced path is timed with every instance changing per frame
+// and with a static scene, where the dirty-range upload sends nothing
+inline void benchInstancing(Shader &perCube, Shader &instanced, GLuint vertexArray, const MeshBuffer &mesh) {
+    InstanceBuffer instances;
+    instances.attach(vertexArray);
+    Shader::Uniform uModel = perCube.uniform("model");
+    Shader::Uniform uNormalMatrix = perCube.uniform("normalMatrix");
+    glState().bindVertexArray(vertexArray);
+
+    for (int cubes : { 12, 10000, 1000000 }) {
+        // Cubes on a square grid in the XZ plane
+        std::vector<glm::mat4> models(cubes);
+        std::vector<glm::mat3> normals(cubes);
+        int side = (int)std::ceil(std::sqrt((float)cubes));
+        for (int i = 0; i < cubes; i++)
+            models[i] = glm::translate(glm::mat4(1.0f), glm::vec3((float)(i % side), 0.0f, (float)(i / side)) * 1.5f);
+        computeNormalMatrices(models.data(), nullptr, normals.data(), cubes);
+        instances.resize(cubes);
+        for (int i = 0; i < cubes; i++)
+            instances.set(i, models[i], normals[i]);
+        instances.upload();
+        // Keep each measurement at a comparable number of cubes drawn
+        int iterations = std::max(1, 200000 / cubes);
+
+        std::cout << "Instancing (" << cubes << " cubes, " << iterations << " iterations)" << std::endl;
+        perCube.use();
+        double loop = benchRun("draw per cube", iterations, [&]() {
+            for (int i = 0; i < cubes; i++) {
+                perCube.setMat4(uModel, models[i]);
+                perCube.setMat3(uNormalMatrix, normals[i]);
+                mesh.draw();
+            }
+        });
+        instanced.use();
+        float offset = 0.0f;
+        double moving = benchRun("instanced, all instances changed", iterations, [&]() {
+            // Nudge every cube so each instance is dirty, as in a fully animated scene
+            offset = offset == 0.0f ? 0.001f : 0.0f;
+            for (int i = 0; i < cubes; i++)
+                instances.set(i, glm::translate(models[i], glm::vec3(offset)), normals[i]);
+            instances.upload();
+            mesh.drawInstanced(cubes);
+        });
+        instances.resetStats();
+        double still = benchRun("instanced, static", iterations, [&]() {
+            instances.upload();
+            mesh.drawInstanced(cubes);
+        });
+        std::cout << "  static uploads: " << instances.stats.uploads << std::endl;
+        std::cout << "  speedup: " << loop / moving << "x changed, " << loop / still << "x static" << std::endl;
+    }
+}
+
+// Wavy side x side vertex grid with analytic normals, standing in for a large scanned or sculpted mesh
+inline Mesh benchGridMesh(int side) {
+    Mesh mesh;
+    mesh.vertices.reserve((size_t)side * side);
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            float u = (float)x / (side - 1), v = (float)z / (side - 1);
+            float px = u * 20.0f - 10.0f, pz = v * 20.0f - 10.0f;
+            Vertex vertex;
+            vertex.position = glm::vec3(px, std::sin(px) * std::cos(pz), pz);
+            vertex.normal = glm::normalize(glm::vec3(-std::cos(px) * std::cos(pz), 1.0f, std::sin(px) * std::sin(pz)));
+            vertex.texCoords = glm::vec2(u, v);
+            mesh.vertices.push_back(vertex);
+        }
+    }
+    for (int z = 0; z + 1 < side; z++) {
+        for (int x = 0; x + 1 < side; x++) {
+            uint32_t i = (uint32_t)(z * side + x);
+            uint32_t quad[6] = { i, i + side, i + 1, i + 1, i + (uint32_t)side, i + side + 1 };
+            mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+        }
+    }
+    return mesh;
+}
+
+// Vertex fetch cost of full-precision vs quantized vertices on a million-vertex mesh. Rasterization
+// is discarded so the vertex stage is what gets measured
+inline void benchVertexFormats(Shader &floatShader, Shader &quantizedShader) {
+    const int iterations = 50;
+    Mesh grid = benchGridMesh(1024);
+    reportQuantizationError("grid", grid.vertices);
+
+    std::cout << "Vertex formats (" << grid.vertices.size() << " vertices, " << grid.indices.size() / 3 << " triangles)" << std::endl;
+    glEnable(GL_RASTERIZER_DISCARD);
+    double floatNs = 0.0;
+    for (VertexFormat format : { VERTEX_FLOAT, VERTEX_QUANTIZED }) {
+        MeshBuffer buffer(grid, format);
+        GLuint vertexArray;
+        glGenVertexArrays(1, &vertexArray);
+        buffer.attach(vertexArray);
+
+        Shader &shader = format == VERTEX_QUANTIZED ? quantizedShader : floatShader;
+        shader.use();
+        shader.setMat4("model", glm::mat4(1.0f));
+        shader.setMat3("normalMatrix", glm::mat3(1.0f));
+        shader.setVec3("positionCenter", buffer.bounds.center);
+        shader.setVec3("positionExtent", buffer.bounds.extent);
+
+        const char *label = format == VERTEX_QUANTIZED ? "quantized (16 bytes/vertex)" : "float (32 bytes/vertex)";
+        double ns = benchRun(label, iterations, [&]() {
+            buffer.draw();
+        });
+        std::cout << "    vertex data " << buffer.vertexBytes / (1024 * 1024) << " MB, "
+                  << buffer.vertexBytes / ns << " GB/s" << std::endl;
+        if (format == VERTEX_FLOAT)
+            floatNs = ns;
+        else
+            std::cout << "  speedup: " << floatNs / ns << "x" << std::endl;
+        glState().deleteVertexArray(vertexArray);
+    }
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+// Submission cost of thousands of different meshes: one vertex array bind, uniform update and draw
+// per mesh, against the mesh pool's indirect commands with and without multi-draw. Rasterization
+// is discarded so the CPU/driver side is what gets measured
+inline void benchMultiDraw(Shader &perObject, Shader &instanced) {
+    const int meshCount = 4096;
+    const int iterations = 50;
+    std::vector<Mesh> meshes;
+    for (int i = 0; i < 16; i++)
+        meshes.push_back(benchGridMesh(2 + i));
+
+    // Separate buffers per object, the way a naive renderer loads each model
+    std::vector<std::unique_ptr<MeshBuffer>> buffers;
+    std::vector<GLuint> vertexArrays(meshCount);
+    glGenVertexArrays(meshCount, vertexArrays.data());
+    MeshPool pool;
+    std::vector<MeshPool::MeshId> ids;
+    std::vector<glm::mat4> models(meshCount);
+    std::vector<glm::mat3> normals(meshCount);
+    for (int i = 0; i < meshCount; i++) {
+        const Mesh &mesh = meshes[i % meshes.size()];
+        buffers.emplace_back(new MeshBuffer(mesh));
+        buffers.back()->attach(vertexArrays[i]);
+        ids.push_back(pool.add(mesh));
+        models[i] = glm::translate(glm::mat4(1.0f), glm::vec3((float)(i % 64), 0.0f, (float)(i / 64)) * 25.0f);
+        normals[i] = glm::mat3(1.0f);
+    }
+    pool.upload();
+    InstanceBuffer instances;
+    instances.attach(pool.VAO);
+    instances.resize(meshCount);
+    for (int i = 0; i < meshCount; i++)
+        instances.set(i, models[i], normals[i]);
+    instances.upload();
+
+    std::cout << "Multi-draw (" << meshCount << " meshes, " << iterations << " iterations)" << std::endl;
+    glEnable(GL_RASTERIZER_DISCARD);
+    Shader::Uniform uModel = perObject.uniform("model");
+    Shader::Uniform uNormalMatrix = perObject.uniform("normalMatrix");
+    perObject.use();
+    double loop = benchRun("vertex array + draw per mesh", iterations, [&]() {
+        for (int i = 0; i < meshCount; i++) {
+            glState().bindVertexArray(vertexArrays[i]);
+            perObject.setMat4(uModel, models[i]);
+            perObject.setMat3(uNormalMatrix, normals[i]);
+            buffers[i]->draw();
+        }
+    });
+    instanced.use();
+    auto submitPool = [&]() {
+        for (int i = 0; i < meshCount; i++)
+            pool.draw(ids[i], 1, i);
+        pool.submit(&instances);
+    };
+    pool.forceEmulation = true;
+    pool.resetStats();
+    double emulated = benchRun("pool, emulated multi-draw", iterations, submitPool);
+    std::cout << "    GL draw calls per frame: " << pool.stats.calls / (iterations + 1) << std::endl;
+    if (MeshPool::multiDrawSupported()) {
+        pool.forceEmulation = false;
+        pool.resetStats();
+        double indirect = benchRun("pool, glMultiDrawElementsIndirect", iterations, submitPool);
+        std::cout << "    GL draw calls per frame: " << pool.stats.calls / (iterations + 1) << std::endl;
+        std::cout << "  speedup: " << loop / emulated << "x emulated, " << loop / indirect << "x multi-draw" << std::endl;
+    }
+    else {
+        std::cout << "  glMultiDrawElementsIndirect unavailable" << std::endl;
+        std::cout << "  speedup: " << loop / emulated << "x emulated" << std::endl;
+    }
+    glDisable(GL_RASTERIZER_DISCARD);
+    for (GLuint vertexArray : vertexArrays)
+        glState().deleteVertexArray(vertexArray);
+}
+
+// Frustum culling of a million boxes and spheres scattered around and behind the camera: the
+// scalar loop, the widest SIMD kernel on one thread, and the kernel across the worker pool
+inline void benchCulling() {
+    const size_t objectCount = 1000000;
+    const int iterations = 50;
+    CullBounds bounds;
+    bounds.resize(objectCount);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    for (size_t i = 0; i < objectCount; i++) {
+        MeshBounds object;
+        object.center = glm::vec3(unit(random) * 80.0f, unit(random) * 50.0f, unit(random) * 100.0f - 20.0f);
+        object.extent = glm::vec3(1.0f + unit(random) * 0.5f, 1.0f + unit(random) * 0.5f, 1.0f + unit(random) * 0.5f);
+        bounds.set(i, object);
+    }
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+    std::vector<uint32_t> expected(objectCount), visible(objectCount);
+
+#if defined(FRUSTUM_CULL_AVX2)
+    const char *kernel = "AVX2";
+#elif defined(FRUSTUM_CULL_SSE)
+    const char *kernel = "SSE";
+#else
+    const char *kernel = "scalar";
+#endif
+    std::cout << "Culling (" << objectCount << " objects, " << kernel << " kernel, "
+              << WorkerPool::instance().threadCount() << " threads, " << iterations << " iterations)" << std::endl;
+    for (CullShape shape : { CULL_BOXES, CULL_SPHERES }) {
+        std::cout << " " << (shape == CULL_BOXES ? "boxes" : "spheres") << std::endl;
+        size_t expectedCount = 0, simdCount = 0, parallelCount = 0;
+        double scalar = benchRun("scalar, one thread", iterations, [&]() {
+            expectedCount = cullScalar(frustum, bounds, shape, 0, objectCount, expected.data());
+        });
+        double simd = benchRun("SIMD, one thread", iterations, [&]() {
+            simdCount = cullRange(frustum, bounds, shape, 0, objectCount, visible.data());
+        });
+        bool simdMatches = simdCount == expectedCount && std::equal(expected.begin(), expected.begin() + expectedCount, visible.begin());
+        double parallel = benchRun("SIMD, worker pool", iterations, [&]() {
+            parallelCount = cullParallel(frustum, bounds, shape, visible.data());
+        });
+        bool parallelMatches = parallelCount == expectedCount && std::equal(expected.begin(), expected.begin() + expectedCount, visible.begin());
+        std::cout << "    visible: " << expectedCount << (simdMatches && parallelMatches ? "" : " MISMATCH") << std::endl;
+        std::cout << "  speedup: " << scalar / simd << "x SIMD, " << scalar / parallel << "x SIMD + threads ("
+                  << parallel / 1e6 << " ms per cull)" << std::endl;
+    }
+}
+
+// BVH build, refit and query costs against object count, with the flat SIMD cull alongside for
+// reference. Objects are scattered as in benchCulling; refit moves every object a little
+inline void benchBVH() {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+    const int queries = 1000;
+
+    std::cout << "BVH (" << WorkerPool::instance().threadCount() << " threads, " << queries << " rays and box queries)" << std::endl;
+    for (size_t objectCount : { (size_t)1000, (size_t)10000, (size_t)100000, (size_t)1000000 }) {
+        std::vector<MeshBounds> objects(objectCount);
+        for (MeshBounds &object : objects) {
+            object.center = glm::vec3(unit(random) * 80.0f, unit(random) * 50.0f, unit(random) * 100.0f - 20.0f);
+            object.extent = glm::vec3(1.0f + unit(random) * 0.5f, 1.0f + unit(random) * 0.5f, 1.0f + unit(random) * 0.5f);
+        }
+        std::vector<MeshBounds> moved = objects;
+        for (MeshBounds &object : moved)
+            object.center += glm::vec3(unit(random), unit(random), unit(random)) * 0.5f;
+        std::vector<glm::vec3> rayOrigins(queries), rayDirections(queries);
+        std::vector<MeshBounds> boxes(queries);
+        for (int i = 0; i < queries; i++) {
+            rayOrigins[i] = glm::vec3(unit(random), unit(random), unit(random)) * 100.0f;
+            rayDirections[i] = glm::vec3(unit(random), unit(random), unit(random));
+            boxes[i].center = glm::vec3(unit(random) * 80.0f, unit(random) * 50.0f, unit(random) * 100.0f - 20.0f);
+            boxes[i].extent = glm::vec3(5.0f);
+        }
+        CullBounds flat;
+        flat.resize(objectCount);
+        for (size_t i = 0; i < objectCount; i++)
+            flat.set(i, objects[i]);
+        std::vector<uint32_t> visible(objectCount);
+        std::vector<uint32_t> overlapping;
+
+        int iterations = (int)std::max<size_t>(2, 2000000 / objectCount);
+        std::cout << " " << objectCount << " objects" << std::endl;
+        BVH bvh;
+        benchRun("build", iterations, [&]() { bvh.build(objects); });
+        float builtCost = bvh.builtCost();
+        bool toggle = false;
+        benchRun("refit", iterations, [&]() {
+            toggle = !toggle;
+            bvh.refit(toggle ? moved : objects);
+        });
+        bvh.build(objects);
+        size_t bvhVisible = 0, flatVisible = 0;
+        benchRun("frustum cull, BVH", iterations, [&]() { bvhVisible = bvh.cullFrustum(frustum, visible.data()); });
+        benchRun("frustum cull, flat SIMD", iterations, [&]() { flatVisible = cullParallel(frustum, flat, CULL_BOXES, visible.data()); });
+        int hits = 0;
+        double rays = benchRun("rays", iterations, [&]() {
+            hits = 0;
+            for (int i = 0; i < queries; i++)
+                hits += bvh.raycast(rayOrigins[i], rayDirections[i]).object >= 0;
+        });
+        double overlaps = benchRun("box overlaps", iterations, [&]() {
+            overlapping.clear();
+            for (int i = 0; i < queries; i++)
+                bvh.overlap(boxes[i], overlapping);
+        });
+        // Scatter everything to show the rebuild heuristic firing
+        std::vector<MeshBounds> scattered = objects;
+        std::shuffle(scattered.begin(), scattered.end(), random);
+        bvh.refit(scattered);
+        std::cout << "    " << bvh.nodeCount() << " nodes, SAH cost " << builtCost << ", " << bvhVisible << " visible"
+                  << (bvhVisible == flatVisible ? "" : " MISMATCH") << ", " << rays / queries << " ns/ray (" << hits
+                  << " hits), " << overlaps / queries << " ns/box query" << std::endl;
+        std::cout << "    scattered without rebuild: SAH cost " << bvh.currentCost()
+                  << (bvh.needsRebuild() ? ", rebuild due" : ", no rebuild") << std::endl;
+    }
+}
+
+// Everything in textures/, which the build copies next to the binary
+const char *const BENCH_TEXTURES[] = { "awesomeface.png", "container.jpg", "crate.png", "crate_specular.png", "navid.jpeg" };
+
+// Peak resident set size of the process so far
+inline double peakResidentMB() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+// Startup cost of everything in textures/ (which the build copies next to the binary), loaded
+// synchronously with loadSync and through TextureLoader. The loader is driven by simulated 60 Hz
+// frames: its first frame can go out as soon as the requests return
+inline void benchTextureLoading(GLuint (*loadSync)(const char *path)) {
+    typedef std::chrono::high_resolution_clock Clock;
+    const auto &paths = BENCH_TEXTURES;
+    const std::chrono::microseconds framePeriod(16667);
+    auto milliseconds = [](Clock::duration duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    };
+    std::cout << "Texture loading (" << sizeof(paths) / sizeof(paths[0]) << " files)" << std::endl;
+
+    auto start = Clock::now();
+    std::vector<GLuint> textures;
+    for (const char *path : paths)
+        textures.push_back(loadSync(path));
+    glFinish();
+    double syncMs = milliseconds(Clock::now() - start);
+    std::cout << "  loadTexture: first frame after " << syncMs << " ms, all loaded after " << syncMs << " ms" << std::endl;
+    for (GLuint texture : textures)
+        glState().deleteTexture(texture);
+
+    start = Clock::now();
+    TextureLoader loader;
+    for (const char *path : paths)
+        loader.request(path);
+    double firstFrameMs = milliseconds(Clock::now() - start);
+    int frames = 0;
+    while (!loader.idle()) {
+        auto frameStart = Clock::now();
+        loader.upload();
+        glFinish();
+        frames++;
+        std::this_thread::sleep_until(frameStart + framePeriod);
+    }
+    double asyncMs = milliseconds(Clock::now() - start);
+    std::cout << "  TextureLoader: first frame after " << firstFrameMs << " ms, all loaded after " << asyncMs << " ms ("
+              << frames << " frames, " << loader.stats.uploadedBytes << " bytes, " << loader.stats.failed << " failed)" << std::endl;
+}
+
+// Synchronous load of every texture in textures/, decoded from the images by loadSync (the app's
+// loadTexture) or, with baked set, mapped from the .ktx2 files texture_baker.cpp wrote into the
+// working directory. Peak RSS never goes down within a process, so each way gets a run of its own:
+// `--bench load-png` and `--bench load-ktx`
+inline void benchTextureStartup(bool baked, GLuint (*loadSync)(const char *path)) {
+    double peakBefore = peakResidentMB();
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<GLuint> textures;
+    int failed = 0;
+    for (const char *image : BENCH_TEXTURES) {
+        std::string path = image;
+        if (baked)
+            path = path.substr(0, path.find_last_of('.')) + ".ktx2";
+        GLuint texture = baked ? loadKtxTexture(path.c_str()) : loadSync(path.c_str());
+        failed += baked && texture == 0;
+        textures.push_back(texture);
+    }
+    glFinish();
+    std::chrono::duration<double, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+    std::cout << "Texture startup, " << (baked ? "baked .ktx2 via mmap" : "stb_image + glGenerateMipmap") << ": "
+              << textures.size() - failed << " textures in " << time.count() << " ms, peak RSS " << peakResidentMB()
+              << " MB (" << peakBefore << " MB before loading)" << std::endl;
+    for (GLuint texture : textures) {
+        if (texture)
+            glState().deleteTexture(texture);
+    }
+}
+
+// Encode rate and quality of the block compressor on everything in textures/: each format at both
+// tiers across the worker pool, and the fast tier on one thread. MB/s counts RGBA8 input; PSNR is
+// over RGB, and over RGBA for the formats that carry alpha
+inline void benchBlockCompression() {
+    WorkerPool &pool = WorkerPool::instance();
+    const char *formatNames[] = { "BC1", "BC3", "BC7" };
+    std::cout << "Block compression (" << pool.threadCount() << " threads)" << std::endl;
+    for (const char *path : BENCH_TEXTURES) {
+        int width, height, channels;
+        unsigned char *pixels = stbi_load(path, &width, &height, &channels, 4);
+        if (!pixels) {
+            std::cout << "  " << path << ": cannot load" << std::endl;
+            continue;
+        }
+        size_t count = (size_t)width * height;
+        std::vector<uint8_t> decoded(count * 4);
+        std::cout << "  " << path << " (" << width << "x" << height << ")" << std::endl;
+        for (int format = BLOCK_BC1; format <= BLOCK_BC7; format++) {
+            for (int quality = COMPRESS_FAST; quality <= COMPRESS_HIGH; quality++) {
+                for (int threaded = 1; threaded >= (quality == COMPRESS_FAST ? 0 : 1); threaded--) {
+                    int iterations = quality == COMPRESS_FAST ? 10 : 1;
+                    std::vector<uint8_t> blocks;
+                    auto start = std::chrono::high_resolution_clock::now();
+                    for (int i = 0; i < iterations; i++)
+                        blocks = compressImage(pixels, width, height, (BlockFormat)format, (CompressionQuality)quality, threaded ? &pool : nullptr);
+                    std::chrono::duration<double> time = (std::chrono::high_resolution_clock::now() - start) / iterations;
+                    decompressImage(blocks.data(), width, height, (BlockFormat)format, decoded.data());
+                    std::cout << "    " << formatNames[format] << (quality == COMPRESS_FAST ? " fast" : " high")
+                              << (threaded ? "" : ", 1 thread") << ": " << count * 4 / time.count() / 1e6 << " MB/s, PSNR "
+                              << imagePSNR(pixels, decoded.data(), count, false) << " dB";
+                    if (format != BLOCK_BC1)
+                        std::cout << " (RGBA " << imagePSNR(pixels, decoded.data(), count, true) << " dB)";
+                    std::cout << std::endl;
+                }
+            }
+        }
+        stbi_image_free(pixels);
+    }
+}
+
+// glGenerateMipmap against generateMipChain on everything in textures/, per image. The CPU chain is
+// timed for each filter on one thread and across the worker pool, and for the box filter once more
+// with the glTexImage2D calls that specify its levels, which is what replaces glGenerateMipmap. On a
+// software driver such as llvmpipe both sides run on the CPU
+inline void benchMipmapGeneration() {
+    WorkerPool &pool = WorkerPool::instance();
+    const char *filterNames[] = { "box", "kaiser", "lanczos" };
+    static const GLenum formats[] = { GL_RED, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    std::cout << "Mipmap generation on " << glGetString(GL_RENDERER) << " (" << pool.threadCount() << " threads)" << std::endl;
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glState().bindTexture(0, texture);
+    glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (const char *path : BENCH_TEXTURES) {
+        int width, height, channels;
+        unsigned char *pixels = stbi_load(path, &width, &height, &channels, 0);
+        if (!pixels) {
+            std::cout << "  " << path << ": cannot load" << std::endl;
+            continue;
+        }
+        GLenum format = formats[channels];
+        std::cout << " " << path << " (" << width << "x" << height << ", " << channels << " channels)" << std::endl;
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+        benchRun("glGenerateMipmap", 10, [&] {
+            glGenerateMipmap(GL_TEXTURE_2D);
+        });
+        for (int filter = MIP_BOX; filter <= MIP_LANCZOS; filter++) {
+            MipOptions options;
+            options.filter = (MipFilter)filter;
+            std::string label = std::string("generateMipChain ") + filterNames[filter];
+            benchRun((label + ", 1 thread").c_str(), 10, [&] {
+                generateMipChain(pixels, width, height, channels, options, nullptr);
+            });
+            benchRun(label.c_str(), 10, [&] {
+                generateMipChain(pixels, width, height, channels, options, &pool);
+            });
+        }
+        benchRun("generateMipChain box + level uploads", 10, [&] {
+            std::vector<std::vector<uint8_t>> levels = generateMipChain(pixels, width, height, channels, MipOptions(), &pool);
+            for (size_t level = 1; level < levels.size(); level++)
+                glTexImage2D(GL_TEXTURE_2D, (GLint)level, format, std::max(width >> level, 1), std::max(height >> level, 1), 0,
+                             format, GL_UNSIGNED_BYTE, levels[level].data());
+        });
+        stbi_image_free(pixels);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glState().deleteTexture(texture);
+}
+
+#endif
@@ -0,0 +1,717 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "worker_pool.h"
+
+// Texel projection and block bounds have SIMD kernels, chosen at compile time
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BLOCK_COMPRESS_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BLOCK_COMPRESS_SSE2 1
+#endif
+
+// CPU encoder for the BCn block formats GPUs sample directly, on 4x4 blocks of RGBA8 texels:
+//   BC1  8 bytes per block, opaque RGB: two RGB565 endpoints and 2-bit indices
+//   BC3  16 bytes, BC1 color plus an alpha block of two 8-bit endpoints and 3-bit indices
+//   BC7  16 bytes, RGBA. Only mode 6 is written: one RGBA7777 endpoint pair with p-bits and
+//        4-bit indices, which covers most content well but not blocks that need partitions
+//
+// COMPRESS_FAST fits each block's endpoints to its inset bounding box and picks indices by
+// projecting texels onto the endpoint line, with SIMD kernels for both; it is meant for runtime
+// use. COMPRESS_HIGH fits the principal axis, chooses indices by exact palette distance and
+// refines the endpoints by least squares, for offline baking
+enum BlockFormat { BLOCK_BC1, BLOCK_BC3, BLOCK_BC7 };
+enum CompressionQuality { COMPRESS_FAST, COMPRESS_HIGH };
+
+inline size_t blockBytes(BlockFormat format) {
+    return format == BLOCK_BC1 ? 8 : 16;
+}
+inline size_t compressedSize(BlockFormat format, uint32_t width, uint32_t height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+// Per-channel minimum and maximum of a block
+inline void blockBounds(const uint8_t block[64], uint8_t minimum[4], uint8_t maximum[4]) {
+#if defined(BLOCK_COMPRESS_AVX2) || defined(BLOCK_COMPRESS_SSE2)
+    __m128i rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = _mm_loadu_si128((const __m128i*)(block + i * 16));
+    __m128i low = _mm_min_epu8(_mm_min_epu8(rows[0], rows[1]), _mm_min_epu8(rows[2], rows[3]));
+    __m128i high = _mm_max_epu8(_mm_max_epu8(rows[0], rows[1]), _mm_max_epu8(rows[2], rows[3]));
+    // Fold the four texels of the row onto the first
+    low = _mm_min_epu8(low, _mm_srli_si128(low, 8));
+    low = _mm_min_epu8(low, _mm_srli_si128(low, 4));
+    high = _mm_max_epu8(high, _mm_srli_si128(high, 8));
+    high = _mm_max_epu8(high, _mm_srli_si128(high, 4));
+    int32_t lowBytes = _mm_cvtsi128_si32(low), highBytes = _mm_cvtsi128_si32(high);
+    memcpy(minimum, &lowBytes, 4);
+    memcpy(maximum, &highBytes, 4);
+#else
+    for (int c = 0; c < 4; c++) {
+        minimum[c] = 255;
+        maximum[c] = 0;
+    }
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++) {
+            minimum[c] = std::min(minimum[c], block[i * 4 + c]);
+            maximum[c] = std::max(maximum[c], block[i * 4 + c]);
+        }
+    }
+#endif
+}
+
+// For each texel, the nearest of levels + 1 evenly spaced steps from e0 (0) to e1 (levels), by
+// projecting it onto the line between them. Give a channel the same value in both endpoints to
+// leave it out
+inline void projectIndices(const uint8_t block[64], const int e0[4], const int e1[4], int levels, uint8_t indices[16]) {
+    int d[4];
+    int lengthSquared = 0, bias = 0;
+    for (int c = 0; c < 4; c++) {
+        d[c] = e1[c] - e0[c];
+        lengthSquared += d[c] * d[c];
+        bias += e0[c] * d[c];
+    }
+    if (lengthSquared == 0) {
+        memset(indices, 0, 16);
+        return;
+    }
+    float scale = (float)levels / lengthSquared;
+#if defined(BLOCK_COMPRESS_AVX2)
+    const __m256i direction = _mm256_setr_epi16(d[0], d[1], d[2], d[3], d[0], d[1], d[2], d[3],
+                                                 d[0], d[1], d[2], d[3], d[0], d[1], d[2], d[3]);
+    for (int i = 0; i < 16; i += 8) {
+        // Two partial dot products per texel: r*dr + g*dg and b*db + a*da
+        __m256i m0 = _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(block + i * 4))), direction);
+        __m256i m1 = _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(block + i * 4 + 16))), direction);
+        __m256 first = _mm256_shuffle_ps(_mm256_castsi256_ps(m0), _mm256_castsi256_ps(m1), _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 second = _mm256_shuffle_ps(_mm256_castsi256_ps(m0), _mm256_castsi256_ps(m1), _MM_SHUFFLE(3, 1, 3, 1));
+        __m256i dots = _mm256_add_epi32(_mm256_castps_si256(first), _mm256_castps_si256(second));
+        // The shuffles interleave the 128-bit lanes; put the texels back in order
+        dots = _mm256_permute4x64_epi64(dots, _MM_SHUFFLE(3, 1, 2, 0));
+        __m256 t = _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(dots), _mm256_set1_ps((float)bias)), _mm256_set1_ps(scale));
+        t = _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), _mm256_set1_ps((float)levels));
+        __m256i index = _mm256_cvtps_epi32(t);
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(index), _mm256_extracti128_si256(index, 1));
+        _mm_storel_epi64((__m128i*)(indices + i), _mm_packus_epi16(words, words));
+    }
+#elif defined(BLOCK_COMPRESS_SSE2)
+    const __m128i direction = _mm_setr_epi16(d[0], d[1], d[2], d[3], d[0], d[1], d[2], d[3]);
+    const __m128i zero = _mm_setzero_si128();
+    for (int i = 0; i < 16; i += 4) {
+        __m128i texels = _mm_loadu_si128((const __m128i*)(block + i * 4));
+        __m128i m0 = _mm_madd_epi16(_mm_unpacklo_epi8(texels, zero), direction);
+        __m128i m1 = _mm_madd_epi16(_mm_unpackhi_epi8(texels, zero), direction);
+        __m128 first = _mm_shuffle_ps(_mm_castsi128_ps(m0), _mm_castsi128_ps(m1), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 second = _mm_shuffle_ps(_mm_castsi128_ps(m0), _mm_castsi128_ps(m1), _MM_SHUFFLE(3, 1, 3, 1));
+        __m128i dots = _mm_add_epi32(_mm_castps_si128(first), _mm_castps_si128(second));
+        __m128 t = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(dots), _mm_set1_ps((float)bias)), _mm_set1_ps(scale));
+        t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps((float)levels));
+        __m128i index = _mm_cvtps_epi32(t);
+        __m128i words = _mm_packs_epi32(index, index);
+        int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+        memcpy(indices + i, &bytes, 4);
+    }
+#else
+    for (int i = 0; i < 16; i++) {
+        const uint8_t *texel = block + i * 4;
+        int dot = texel[0] * d[0] + texel[1] * d[1] + texel[2] * d[2] + texel[3] * d[3];
+        float t = std::min(std::max((dot - bias) * scale, 0.0f), (float)levels);
+        // Round half to even like the SIMD conversions
+        indices[i] = (uint8_t)std::lrint(t);
+    }
+#endif
+}
+
+// Endpoint fitting shared by the formats, over the first `channels` channels of each texel
+
+// Inset bounding box, oriented along the diagonal the texels follow: channels that fall as green
+// rises are flipped. Cheap, and close to the principal axis for most blocks
+inline void fitBoxEndpoints(const uint8_t block[64], int channels, float e0[4], float e1[4]) {
+    uint8_t low[4], high[4];
+    blockBounds(block, low, high);
+    float mean[4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < channels; c++)
+            mean[c] += block[i * 4 + c];
+    }
+    float covariance[4] = {};
+    for (int i = 0; i < 16; i++) {
+        float green = block[i * 4 + 1] - mean[1] / 16.0f;
+        for (int c = 0; c < channels; c++)
+            covariance[c] += (block[i * 4 + c] - mean[c] / 16.0f) * green;
+    }
+    for (int c = 0; c < 4; c++) {
+        e0[c] = e1[c] = 0.0f;
+        if (c >= channels)
+            continue;
+        // The extremes rarely deserve a palette entry each
+        float inset = (high[c] - low[c]) / 16.0f;
+        e0[c] = low[c] + inset;
+        e1[c] = high[c] - inset;
+        if (covariance[c] < 0.0f)
+            std::swap(e0[c], e1[c]);
+    }
+}
+
+// Extent of the texels along their principal axis, found by power iteration on the covariance
+inline void fitPrincipalEndpoints(const uint8_t block[64], int channels, float e0[4], float e1[4]) {
+    float mean[4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < channels; c++)
+            mean[c] += block[i * 4 + c] / 16.0f;
+    }
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++)
+                covariance[a][b] += (block[i * 4 + a] - mean[a]) * (block[i * 4 + b] - mean[b]);
+        }
+    }
+    float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        float length = 0.0f;
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++)
+                next[a] += covariance[a][b] * axis[b];
+            length = std::max(length, std::abs(next[a]));
+        }
+        // A flat block has no axis; any direction does
+        if (length < 1e-6f)
+            break;
+        for (int a = 0; a < channels; a++)
+            axis[a] = next[a] / length;
+    }
+    float lengthSquared = 0.0f;
+    for (int c = 0; c < channels; c++)
+        lengthSquared += axis[c] * axis[c];
+    float low = 0.0f, high = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++)
+            t += (block[i * 4 + c] - mean[c]) * axis[c];
+        t /= lengthSquared;
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    for (int c = 0; c < 4; c++) {
+        e0[c] = c < channels ? mean[c] + axis[c] * low : 0.0f;
+        e1[c] = c < channels ? mean[c] + axis[c] * high : 0.0f;
+    }
+}
+
+// Least-squares endpoints for fixed interpolation weights (0 at e0, 1 at e1). Returns false, leaving
+// the endpoints alone, when every texel has the same weight
+inline bool refineEndpoints(const uint8_t block[64], int channels, const float weights[16], float e0[4], float e1[4]) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (int i = 0; i < 16; i++) {
+        float b = weights[i], a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channels; c++) {
+            ax[c] += a * block[i * 4 + c];
+            bx[c] += b * block[i * 4 + c];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f)
+        return false;
+    for (int c = 0; c < channels; c++) {
+        e0[c] = std::min(std::max((bb * ax[c] - ab * bx[c]) / determinant, 0.0f), 255.0f);
+        e1[c] = std::min(std::max((aa * bx[c] - ab * ax[c]) / determinant, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+// Nearest palette entry for each texel by squared distance over `channels`; returns the total error
+inline int nearestIndices(const uint8_t block[64], int channels, const int palette[][4], int count, uint8_t indices[16]) {
+    int total = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = std::numeric_limits<int>::max();
+        for (int entry = 0; entry < count; entry++) {
+            int error = 0;
+            for (int c = 0; c < channels; c++) {
+                int difference = block[i * 4 + c] - palette[entry][c];
+                error += difference * difference;
+            }
+            if (error < best) {
+                best = error;
+                indices[i] = (uint8_t)entry;
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+// Little-endian bit packing, as the BCn layouts count bits from the first byte's lowest
+struct BlockBitWriter {
+    uint8_t *out;
+    int bit = 0;
+    void write(uint32_t value, int bits) {
+        for (int i = 0; i < bits; i++, bit++) {
+            if (value >> i & 1)
+                out[bit >> 3] |= (uint8_t)(1 << (bit & 7));
+        }
+    }
+};
+struct BlockBitReader {
+    const uint8_t *in;
+    int bit = 0;
+    uint32_t read(int bits) {
+        uint32_t value = 0;
+        for (int i = 0; i < bits; i++, bit++)
+            value |= (uint32_t)(in[bit >> 3] >> (bit & 7) & 1) << i;
+        return value;
+    }
+};
+
+// BC1 color
+
+inline uint16_t packRGB565(const float color[3]) {
+    int r = (int)std::lrint(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f);
+    int g = (int)std::lrint(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f);
+    int b = (int)std::lrint(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f);
+    return (uint16_t)(r << 11 | g << 5 | b);
+}
+inline void unpackRGB565(uint16_t packed, int color[4]) {
+    int r = packed >> 11 & 31, g = packed >> 5 & 63, b = packed & 31;
+    color[0] = r << 3 | r >> 2;
+    color[1] = g << 2 | g >> 4;
+    color[2] = b << 3 | b >> 2;
+    color[3] = 255;
+}
+// Colors in projection order: e0, one third, two thirds, e1
+inline void colorRamp(uint16_t c0, uint16_t c1, int ramp[4][4]) {
+    unpackRGB565(c0, ramp[0]);
+    unpackRGB565(c1, ramp[3]);
+    for (int c = 0; c < 4; c++) {
+        ramp[1][c] = (2 * ramp[0][c] + ramp[3][c] + 1) / 3;
+        ramp[2][c] = (ramp[0][c] + 2 * ramp[3][c] + 1) / 3;
+    }
+}
+
+// The color half of BC1 and BC3, always in four-color mode
+inline void encodeColorBlock(const uint8_t block[64], uint8_t out[8], CompressionQuality quality) {
+    float e0[4], e1[4];
+    if (quality == COMPRESS_FAST)
+        fitBoxEndpoints(block, 3, e0, e1);
+    else
+        fitPrincipalEndpoints(block, 3, e0, e1);
+
+    uint16_t c0 = packRGB565(e0), c1 = packRGB565(e1);
+    uint8_t ramp[16];
+    int ramp4[4][4];
+    colorRamp(c0, c1, ramp4);
+    int error = 0;
+    if (quality == COMPRESS_FAST) {
+        int q0[4] = { ramp4[0][0], ramp4[0][1], ramp4[0][2], 0 }, q1[4] = { ramp4[3][0], ramp4[3][1], ramp4[3][2], 0 };
+        projectIndices(block, q0, q1, 3, ramp);
+    }
+    else {
+        error = nearestIndices(block, 3, ramp4, 4, ramp);
+        for (int iteration = 0; iteration < 2 && error > 0; iteration++) {
+            float weights[16];
+            for (int i = 0; i < 16; i++)
+                weights[i] = ramp[i] / 3.0f;
+            if (!refineEndpoints(block, 3, weights, e0, e1))
+                break;
+            uint16_t r0 = packRGB565(e0), r1 = packRGB565(e1);
+            uint8_t refined[16];
+            colorRamp(r0, r1, ramp4);
+            int refinedError = nearestIndices(block, 3, ramp4, 4, refined);
+            if (refinedError >= error)
+                break;
+            error = refinedError;
+            c0 = r0;
+            c1 = r1;
+            memcpy(ramp, refined, 16);
+        }
+    }
+
+    // Four-color mode needs c0 > c1; equal endpoints decode the same in either mode
+    if (c0 < c1) {
+        std::swap(c0, c1);
+        for (uint8_t &index : ramp)
+            index = (uint8_t)(3 - index);
+    }
+    // Ramp order to BC1 index order: e0, e1, one third, two thirds
+    static const uint8_t order[4] = { 0, 2, 3, 1 };
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; i++)
+        bits |= (uint32_t)(c0 == c1 ? 0 : order[ramp[i]]) << (i * 2);
+    memcpy(out, &c0, 2);
+    memcpy(out + 2, &c1, 2);
+    memcpy(out + 4, &bits, 4);
+}
+
+inline void decodeColorBlock(const uint8_t in[8], uint8_t block[64], bool allowThreeColor) {
+    uint16_t c0, c1;
+    uint32_t bits;
+    memcpy(&c0, in, 2);
+    memcpy(&c1, in + 2, 2);
+    memcpy(&bits, in + 4, 4);
+    int palette[4][4];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 4; c++) {
+        if (c0 > c1 || !allowThreeColor) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+        }
+        else {
+            palette[2][c] = (palette[0][c] + palette[1][c] + 1) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        const int *color = palette[bits >> (i * 2) & 3];
+        for (int c = 0; c < 4; c++)
+            block[i * 4 + c] = (uint8_t)color[c];
+    }
+}
+
+// BC3 alpha
+
+inline void alphaPalette(int a0, int a1, int palette[8]) {
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (int i = 2; i < 8; i++)
+            palette[i] = ((8 - i) * a0 + (i - 1) * a1 + 3) / 7;
+    }
+    else {
+        for (int i = 2; i < 6; i++)
+            palette[i] = ((6 - i) * a0 + (i - 1) * a1 + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+inline int alphaIndices(const uint8_t block[64], const int palette[8], uint8_t indices[16]) {
+    int total = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = std::numeric_limits<int>::max();
+        for (int entry = 0; entry < 8; entry++) {
+            int error = (block[i * 4 + 3] - palette[entry]) * (block[i * 4 + 3] - palette[entry]);
+            if (error < best) {
+                best = error;
+                indices[i] = (uint8_t)entry;
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+inline void encodeAlphaBlock(const uint8_t block[64], uint8_t out[8], CompressionQuality quality) {
+    uint8_t low[4], high[4];
+    blockBounds(block, low, high);
+    int a0 = high[3], a1 = low[3];
+    uint8_t indices[16] = {};
+    if (a0 > a1) {
+        if (quality == COMPRESS_FAST) {
+            // Eight evenly spaced levels from a1 to a0; level L is index 1 at 0, 0 at 7, else 8 - L
+            int q0[4] = { 0, 0, 0, a1 }, q1[4] = { 0, 0, 0, a0 };
+            projectIndices(block, q0, q1, 7, indices);
+            for (uint8_t &index : indices)
+                index = (uint8_t)(index == 0 ? 1 : index == 7 ? 0 : 8 - index);
+        }
+        else {
+            int palette[8];
+            alphaPalette(a0, a1, palette);
+            int error = alphaIndices(block, palette, indices);
+            // Six levels between the values other than 0 and 255, which get exact entries
+            int inner0 = 255, inner1 = 0;
+            for (int i = 0; i < 16; i++) {
+                int alpha = block[i * 4 + 3];
+                if (alpha != 0 && alpha != 255) {
+                    inner0 = std::min(inner0, alpha);
+                    inner1 = std::max(inner1, alpha);
+                }
+            }
+            if (inner0 > inner1)
+                inner0 = inner1 = 0;
+            uint8_t sixIndices[16];
+            alphaPalette(inner0, inner1, palette);
+            if (alphaIndices(block, palette, sixIndices) < error) {
+                a0 = inner0;
+                a1 = inner1;
+                memcpy(indices, sixIndices, 16);
+            }
+        }
+    }
+    out[0] = (uint8_t)a0;
+    out[1] = (uint8_t)a1;
+    memset(out + 2, 0, 6);
+    BlockBitWriter writer{ out + 2 };
+    for (int i = 0; i < 16; i++)
+        writer.write(indices[i], 3);
+}
+
+inline void decodeAlphaBlock(const uint8_t in[8], uint8_t block[64]) {
+    int palette[8];
+    alphaPalette(in[0], in[1], palette);
+    BlockBitReader reader{ in + 2 };
+    for (int i = 0; i < 16; i++)
+        block[i * 4 + 3] = (uint8_t)palette[reader.read(3)];
+}
+
+// BC7 mode 6
+
+const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// An endpoint as 7 bits per channel plus a shared low bit
+struct BC7Endpoint {
+    int bits[4];
+    int p;
+    void expand(int color[4]) const {
+        for (int c = 0; c < 4; c++)
+            color[c] = bits[c] << 1 | p;
+    }
+};
+
+// Nearest representable endpoint with the given p-bit, or with the better one when p < 0
+inline BC7Endpoint quantizeBC7Endpoint(const float color[4], int p) {
+    BC7Endpoint best = {};
+    float bestError = std::numeric_limits<float>::max();
+    for (int candidate = 0; candidate < 2; candidate++) {
+        if (p >= 0 && candidate != p)
+            continue;
+        BC7Endpoint endpoint;
+        endpoint.p = candidate;
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            float value = std::min(std::max(color[c], 0.0f), 255.0f);
+            endpoint.bits[c] = std::min(std::max((int)std::lrint((value - candidate) / 2.0f), 0), 127);
+            float difference = (endpoint.bits[c] << 1 | candidate) - value;
+            error += difference * difference;
+        }
+        if (error < bestError) {
+            bestError = error;
+            best = endpoint;
+        }
+    }
+    return best;
+}
+
+inline void bc7Palette(const BC7Endpoint &e0, const BC7Endpoint &e1, int palette[16][4]) {
+    int c0[4], c1[4];
+    e0.expand(c0);
+    e1.expand(c1);
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++)
+            palette[i][c] = ((64 - BC7_WEIGHTS4[i]) * c0[c] + BC7_WEIGHTS4[i] * c1[c] + 32) >> 6;
+    }
+}
+
+inline void encodeBC7Block(const uint8_t block[64], uint8_t out[16], CompressionQuality quality) {
+    float e0[4], e1[4];
+    BC7Endpoint q0, q1;
+    uint8_t indices[16];
+    if (quality == COMPRESS_FAST) {
+        fitBoxEndpoints(block, 4, e0, e1);
+        q0 = quantizeBC7Endpoint(e0, -1);
+        q1 = quantizeBC7Endpoint(e1, -1);
+        // The 4-bit weights are close enough to even steps to project onto
+        int c0[4], c1[4];
+        q0.expand(c0);
+        q1.expand(c1);
+        projectIndices(block, c0, c1, 15, indices);
+    }
+    else {
+        fitPrincipalEndpoints(block, 4, e0, e1);
+        int palette[16][4];
+        int error = std::numeric_limits<int>::max();
+        for (int iteration = 0; iteration < 3 && error > 0; iteration++) {
+            if (iteration > 0) {
+                float weights[16];
+                for (int i = 0; i < 16; i++)
+                    weights[i] = BC7_WEIGHTS4[indices[i]] / 64.0f;
+                if (!refineEndpoints(block, 4, weights, e0, e1))
+                    break;
+            }
+            // Every p-bit pair, as the better p-bit per endpoint is not always the better pair
+            bool improved = false;
+            for (int pair = 0; pair < 4; pair++) {
+                BC7Endpoint t0 = quantizeBC7Endpoint(e0, pair & 1), t1 = quantizeBC7Endpoint(e1, pair >> 1);
+                uint8_t candidate[16];
+                bc7Palette(t0, t1, palette);
+                int candidateError = nearestIndices(block, 4, palette, 16, candidate);
+                if (candidateError < error) {
+                    error = candidateError;
+                    q0 = t0;
+                    q1 = t1;
+                    memcpy(indices, candidate, 16);
+                    improved = true;
+                }
+            }
+            if (!improved)
+                break;
+        }
+    }
+
+    // The first texel's index has an implicit zero top bit
+    if (indices[0] & 8) {
+        std::swap(q0, q1);
+        for (uint8_t &index : indices)
+            index = (uint8_t)(15 - index);
+    }
+    memset(out, 0, 16);
+    BlockBitWriter writer{ out };
+    writer.write(1 << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        writer.write(q0.bits[c], 7);
+        writer.write(q1.bits[c], 7);
+    }
+    writer.write(q0.p, 1);
+    writer.write(q1.p, 1);
+    writer.write(indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        writer.write(indices[i], 4);
+}
+
+// Decodes mode 6 blocks, the only mode encodeBC7Block writes; other modes come out black
+inline void decodeBC7Block(const uint8_t in[16], uint8_t block[64]) {
+    if ((in[0] & 0x7F) != 0x40) {
+        memset(block, 0, 64);
+        return;
+    }
+    BlockBitReader reader{ in };
+    reader.read(7);
+    BC7Endpoint e0, e1;
+    for (int c = 0; c < 4; c++) {
+        e0.bits[c] = (int)reader.read(7);
+        e1.bits[c] = (int)reader.read(7);
+    }
+    e0.p = (int)reader.read(1);
+    e1.p = (int)reader.read(1);
+    int palette[16][4];
+    bc7Palette(e0, e1, palette);
+    for (int i = 0; i < 16; i++) {
+        const int *color = palette[reader.read(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; c++)
+            block[i * 4 + c] = (uint8_t)color[c];
+    }
+}
+
+// Whole images
+
+inline void encodeBlock(BlockFormat format, const uint8_t block[64], uint8_t *out, CompressionQuality quality) {
+    switch (format) {
+        case BLOCK_BC1:
+            encodeColorBlock(block, out, quality);
+            break;
+        case BLOCK_BC3:
+            encodeAlphaBlock(block, out, quality);
+            encodeColorBlock(block, out + 8, quality);
+            break;
+        case BLOCK_BC7:
+            encodeBC7Block(block, out, quality);
+            break;
+    }
+}
+
+inline void decodeBlock(BlockFormat format, const uint8_t *in, uint8_t block[64]) {
+    switch (format) {
+        case BLOCK_BC1:
+            decodeColorBlock(in, block, true);
+            break;
+        case BLOCK_BC3:
+            decodeColorBlock(in + 8, block, false);
+            decodeAlphaBlock(in, block);
+            break;
+        case BLOCK_BC7:
+            decodeBC7Block(in, block);
+            break;
+    }
+}
+
+// Compress RGBA8 texels into blocks stored row by row. Blocks past the right or bottom edge repeat
+// the last column or row. Rows of blocks are shared out across pool, or encoded inline without one
+inline std::vector<uint8_t> compressImage(const uint8_t *rgba, uint32_t width, uint32_t height, BlockFormat format,
+                                          CompressionQuality quality, WorkerPool *pool = nullptr) {
+    uint32_t blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    size_t bytes = blockBytes(format);
+    std::vector<uint8_t> blocks(compressedSize(format, width, height));
+    auto encodeRows = [&](size_t begin, size_t end, size_t) {
+        uint8_t block[64];
+        for (size_t blockY = begin; blockY < end; blockY++) {
+            for (uint32_t blockX = 0; blockX < blocksWide; blockX++) {
+                for (uint32_t y = 0; y < 4; y++) {
+                    const uint8_t *row = rgba + (size_t)std::min<uint32_t>((uint32_t)blockY * 4 + y, height - 1) * width * 4;
+                    if (blockX * 4 + 4 <= width) {
+                        memcpy(block + y * 16, row + blockX * 16, 16);
+                        continue;
+                    }
+                    for (uint32_t x = 0; x < 4; x++)
+                        memcpy(block + y * 16 + x * 4, row + (size_t)std::min(blockX * 4 + x, width - 1) * 4, 4);
+                }
+                encodeBlock(format, block, blocks.data() + (blockY * blocksWide + blockX) * bytes, quality);
+            }
+        }
+    };
+    if (pool)
+        pool->parallelFor(blocksHigh, pool->chunksFor(blocksHigh, 4), encodeRows);
+    else
+        encodeRows(0, blocksHigh, 0);
+    return blocks;
+}
+
+inline void decompressImage(const uint8_t *blocks, uint32_t width, uint32_t height, BlockFormat format, uint8_t *rgba) {
+    uint32_t blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    uint8_t block[64];
+    for (uint32_t blockY = 0; blockY < blocksHigh; blockY++) {
+        for (uint32_t blockX = 0; blockX < blocksWide; blockX++) {
+            decodeBlock(format, blocks + ((size_t)blockY * blocksWide + blockX) * blockBytes(format), block);
+            for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++) {
+                for (uint32_t x = 0; x < 4 && blockX * 4 + x < width; x++)
+                    memcpy(rgba + ((size_t)(blockY * 4 + y) * width + blockX * 4 + x) * 4, block + y * 16 + x * 4, 4);
+            }
+        }
+    }
+}
+
+// RGBA8 copy of 3- or 4-channel texels, alpha 255 where there is none
+inline std::vector<uint8_t> expandToRGBA(const uint8_t *pixels, size_t count, int channels) {
+    std::vector<uint8_t> rgba(count * 4, 255);
+    for (size_t i = 0; i < count; i++)
+        memcpy(&rgba[i * 4], pixels + i * channels, std::min(channels, 4));
+    return rgba;
+}
+
+inline bool hasTranslucentTexels(const uint8_t *rgba, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (rgba[i * 4 + 3] != 255)
+            return true;
+    }
+    return false;
+}
+
+// Peak signal-to-noise ratio in dB of b against a, both RGBA8, over RGB or RGBA. Infinite when equal
+inline double imagePSNR(const uint8_t *a, const uint8_t *b, size_t count, bool withAlpha) {
+    int channels = withAlpha ? 4 : 3;
+    double sum = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        for (int c = 0; c < channels; c++) {
+            double difference = (double)a[i * 4 + c] - b[i * 4 + c];
+            sum += difference * difference;
+        }
+    }
+    double meanSquared = sum / ((double)count * channels);
+    return meanSquared == 0.0 ? std::numeric_limits<double>::infinity() : 10.0 * std::log10(255.0 * 255.0 / meanSquared);
+}
+
+#endif
@@ -0,0 +1,544 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "frustum.h"
+#include "vertex_format.h"
+#include "worker_pool.h"
+
+// Bounding volume hierarchy over object boxes, for hierarchical frustum culling, ray queries and
+// box overlap queries.
+//
+// Nodes live in one flat array, 32 bytes each. Children are allocated in pairs, so an internal
+// node only stores its left child's index and the right one follows it, and every child comes
+// after its parent in the array. Each subtree's objects are a contiguous run of the object index
+// array, which a leaf addresses by first and count.
+//
+// Built top-down with a binned surface area heuristic. Large scenes build the top levels on the
+// calling thread and the subtrees below them in parallel on the worker pool. When objects move,
+// refit() updates the boxes bottom-up without changing the topology; the tree then degrades as
+// objects drift from the places it was built for, which needsRebuild() detects from the SAH cost
+class BVH {
+public:
+    struct Node {
+        glm::vec3 min;
+        // Leaf: first entry in the object index array. Internal: index of the left child
+        uint32_t leftOrFirst;
+        glm::vec3 max;
+        // Objects in a leaf, 0 for an internal node
+        uint32_t count;
+
+        bool isLeaf() const {
+            return count > 0;
+        }
+    };
+    static_assert(sizeof(Node) == 32, "two nodes per cache line");
+
+    struct RayHit {
+        // -1 when nothing was hit
+        int32_t object = -1;
+        float distance = 0.0f;
+    };
+
+    // Objects up to which a node becomes a leaf whatever the SAH says, and above which it never does
+    static const uint32_t MIN_LEAF_SIZE = 2;
+    static const uint32_t MAX_LEAF_SIZE = 16;
+    // Deeper nodes become leaves however many objects they hold, which bounds the traversal stacks
+    static const int MAX_DEPTH = 60;
+    // Builds over this many objects run subtrees on the worker pool
+    static const size_t PARALLEL_BUILD_OBJECTS = 16 * 1024;
+    // Rebuild once the SAH cost grew past this factor of the cost the tree was built with
+    float rebuildThreshold = 1.5f;
+
+    void build(const MeshBounds *objects, size_t count) {
+        work.resize(count);
+        for (size_t i = 0; i < count; i++)
+            work[i] = BuildObject{ objects[i].center - objects[i].extent, (uint32_t)i, objects[i].center + objects[i].extent, 0.0f };
+        nodes.clear();
+        nodes.reserve(count ? 2 * count : 1);
+        nodes.push_back(Node());
+        nodes[0].leftOrFirst = 0;
+        nodes[0].count = (uint32_t)count;
+        if (count == 0) {
+            nodes[0].min = nodes[0].max = glm::vec3(0.0f);
+            objectIndices.clear();
+            boxMin.clear();
+            boxMax.clear();
+            buildCost = cost = 0.0f;
+            return;
+        }
+        updateNodeBounds(nodes, 0);
+
+        WorkerPool &workers = WorkerPool::instance();
+        if (count < PARALLEL_BUILD_OBJECTS || workers.threadCount() == 1) {
+            subdivide(nodes, 0, 0, SIZE_MAX);
+        }
+        else {
+            // Split serially until the pieces are small enough to spread across the threads, then
+            // build each piece into its own array and append it
+            size_t taskObjects = std::max<size_t>(count / (8 * workers.threadCount()), 4096);
+            std::vector<Task> tasks;
+            subdivide(nodes, 0, 0, taskObjects, &tasks);
+            std::vector<std::vector<Node>> subtrees(tasks.size());
+            workers.parallelFor(tasks.size(), tasks.size(), [&](size_t begin, size_t end, size_t) {
+                for (size_t task = begin; task < end; task++) {
+                    std::vector<Node> &local = subtrees[task];
+                    local.reserve(2 * nodes[tasks[task].node].count);
+                    local.push_back(nodes[tasks[task].node]);
+                    subdivide(local, 0, tasks[task].depth, SIZE_MAX);
+                }
+            });
+            for (size_t task = 0; task < tasks.size(); task++)
+                appendSubtree(tasks[task].node, subtrees[task]);
+        }
+        // Keep the objects in the order the leaves reference them
+        objectIndices.resize(count);
+        boxMin.resize(count);
+        boxMax.resize(count);
+        for (size_t k = 0; k < count; k++) {
+            objectIndices[k] = work[k].index;
+            boxMin[k] = work[k].min;
+            boxMax[k] = work[k].max;
+        }
+        std::vector<BuildObject>().swap(work);
+        buildCost = cost = sahCost();
+    }
+    void build(const std::vector<MeshBounds> &objects) {
+        build(objects.data(), objects.size());
+    }
+
+    // Update every node's box for objects that moved, keeping the tree. count must match the build;
+    // otherwise nothing changes and update() is the call to make
+    void refit(const MeshBounds *objects, size_t count) {
+        if (count == 0 || count != objectCount())
+            return;
+        for (size_t k = 0; k < count; k++) {
+            const MeshBounds &object = objects[objectIndices[k]];
+            boxMin[k] = object.center - object.extent;
+            boxMax[k] = object.center + object.extent;
+        }
+        // Children come after their parents, so one backwards pass sees children first
+        for (size_t i = nodes.size(); i-- > 0;) {
+            Node &node = nodes[i];
+            if (node.isLeaf()) {
+                glm::vec3 lo = boxMin[node.leftOrFirst], hi = boxMax[node.leftOrFirst];
+                for (uint32_t k = node.leftOrFirst + 1; k < node.leftOrFirst + node.count; k++) {
+                    lo = glm::min(lo, boxMin[k]);
+                    hi = glm::max(hi, boxMax[k]);
+                }
+                node.min = lo;
+                node.max = hi;
+            }
+            else {
+                const Node &left = nodes[node.leftOrFirst];
+                const Node &right = nodes[node.leftOrFirst + 1];
+                node.min = glm::min(left.min, right.min);
+                node.max = glm::max(left.max, right.max);
+            }
+        }
+        cost = sahCost();
+    }
+    void refit(const std::vector<MeshBounds> &objects) {
+        refit(objects.data(), objects.size());
+    }
+
+    // True once refits have made the tree expensive enough to be worth building again
+    bool needsRebuild() const {
+        return cost > buildCost * rebuildThreshold;
+    }
+    // Refit for moved objects, rebuilding instead when the count changed or the tree degraded.
+    // Returns whether it rebuilt
+    bool update(const std::vector<MeshBounds> &objects) {
+        if (objects.size() != objectCount() || nodes.empty()) {
+            build(objects);
+            return true;
+        }
+        refit(objects);
+        if (!needsRebuild())
+            return false;
+        build(objects);
+        return true;
+    }
+
+    size_t objectCount() const {
+        return objectIndices.size();
+    }
+    size_t nodeCount() const {
+        return nodes.size();
+    }
+    const std::vector<Node> &nodeArray() const {
+        return nodes;
+    }
+    // Expected cost of a query relative to one box test, from the surface area heuristic: the
+    // area-weighted node visits and object tests. Lower is better
+    float currentCost() const {
+        return cost;
+    }
+    float builtCost() const {
+        return buildCost;
+    }
+
+    // Indices of objects whose boxes intersect the frustum, in tree order. visible must hold
+    // objectCount() indices. Planes a node lies fully inside of are not tested again below it,
+    // and a node inside all six takes its whole subtree without testing any boxes
+    size_t cullFrustum(const Frustum &frustum, uint32_t *visible) const {
+        if (objectCount() == 0)
+            return 0;
+        size_t found = 0;
+        struct Entry { uint32_t node; uint32_t planes; };
+        Entry stack[2 * MAX_DEPTH + 2];
+        int depth = 0;
+        stack[depth++] = Entry{ 0, (1u << Frustum::PLANE_COUNT) - 1 };
+        while (depth > 0) {
+            Entry entry = stack[--depth];
+            const Node &node = nodes[entry.node];
+            uint32_t planes = entry.planes;
+            if (!classifyBox(frustum, (node.min + node.max) * 0.5f, (node.max - node.min) * 0.5f, planes))
+                continue;
+            if (!node.isLeaf()) {
+                stack[depth++] = Entry{ node.leftOrFirst + 1, planes };
+                stack[depth++] = Entry{ node.leftOrFirst, planes };
+                continue;
+            }
+            for (uint32_t k = node.leftOrFirst; k < node.leftOrFirst + node.count; k++) {
+                uint32_t objectPlanes = planes;
+                visible[found] = objectIndices[k];
+                found += planes == 0 || classifyBox(frustum, (boxMin[k] + boxMax[k]) * 0.5f, (boxMax[k] - boxMin[k]) * 0.5f, objectPlanes);
+            }
+        }
+        return found;
+    }
+
+    // Nearest object box the ray enters within maxDistance. direction need not be normalized;
+    // distances are in units of its length
+    RayHit raycast(const glm::vec3 &origin, const glm::vec3 &direction,
+                   float maxDistance = std::numeric_limits<float>::infinity()) const {
+        RayHit hit;
+        if (objectCount() == 0)
+            return hit;
+        glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        float nearest = maxDistance;
+        uint32_t stack[2 * MAX_DEPTH + 2];
+        int depth = 0;
+        stack[depth++] = 0;
+        while (depth > 0) {
+            const Node &node = nodes[stack[--depth]];
+            if (node.isLeaf()) {
+                for (uint32_t k = node.leftOrFirst; k < node.leftOrFirst + node.count; k++) {
+                    float distance = rayBox(origin, inverse, boxMin[k], boxMax[k], nearest);
+                    if (distance < nearest) {
+                        nearest = distance;
+                        hit.object = (int32_t)objectIndices[k];
+                        hit.distance = distance;
+                    }
+                }
+                continue;
+            }
+            // Visit the nearer child first so the farther one is more likely to be pruned
+            uint32_t near = node.leftOrFirst, far = node.leftOrFirst + 1;
+            float nearDistance = rayBox(origin, inverse, nodes[near].min, nodes[near].max, nearest);
+            float farDistance = rayBox(origin, inverse, nodes[far].min, nodes[far].max, nearest);
+            if (farDistance < nearDistance) {
+                std::swap(near, far);
+                std::swap(nearDistance, farDistance);
+            }
+            if (farDistance < nearest)
+                stack[depth++] = far;
+            if (nearDistance < nearest)
+                stack[depth++] = near;
+        }
+        return hit;
+    }
+
+    // Objects whose boxes overlap the given box, appended to overlapping
+    void overlap(const MeshBounds &bounds, std::vector<uint32_t> &overlapping) const {
+        if (objectCount() == 0)
+            return;
+        glm::vec3 lo = bounds.center - bounds.extent, hi = bounds.center + bounds.extent;
+        uint32_t stack[2 * MAX_DEPTH + 2];
+        int depth = 0;
+        stack[depth++] = 0;
+        while (depth > 0) {
+            const Node &node = nodes[stack[--depth]];
+            if (!boxesOverlap(lo, hi, node.min, node.max))
+                continue;
+            if (!node.isLeaf()) {
+                stack[depth++] = node.leftOrFirst + 1;
+                stack[depth++] = node.leftOrFirst;
+                continue;
+            }
+            for (uint32_t k = node.leftOrFirst; k < node.leftOrFirst + node.count; k++) {
+                if (boxesOverlap(lo, hi, boxMin[k], boxMax[k]))
+                    overlapping.push_back(objectIndices[k]);
+            }
+        }
+    }
+
+private:
+    static const int SAH_BINS = 12;
+
+    // A node left for a worker to build, and its depth in the tree
+    struct Task {
+        uint32_t node;
+        int depth;
+    };
+
+    // An object's box during build(). Nodes partition these in place rather than an index array,
+    // so the binning passes read memory in order
+    struct BuildObject {
+        glm::vec3 min;
+        uint32_t index;
+        glm::vec3 max;
+        float padding;
+    };
+
+    struct Bin {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+        uint32_t count = 0;
+    };
+    struct Bins {
+        Bin bins[3][SAH_BINS];
+        void merge(const Bins &other) {
+            for (int axis = 0; axis < 3; axis++) {
+                for (int i = 0; i < SAH_BINS; i++) {
+                    Bin &bin = bins[axis][i];
+                    bin.min = glm::min(bin.min, other.bins[axis][i].min);
+                    bin.max = glm::max(bin.max, other.bins[axis][i].max);
+                    bin.count += other.bins[axis][i].count;
+                }
+            }
+        }
+    };
+
+    std::vector<Node> nodes;
+    // Objects in tree order: a leaf covers entries [leftOrFirst, leftOrFirst + count)
+    std::vector<uint32_t> objectIndices;
+    std::vector<glm::vec3> boxMin, boxMax;
+    std::vector<BuildObject> work;
+    float buildCost = 0.0f;
+    float cost = 0.0f;
+
+    static float area(const glm::vec3 &min, const glm::vec3 &max) {
+        glm::vec3 size = max - min;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+    static bool boxesOverlap(const glm::vec3 &aMin, const glm::vec3 &aMax, const glm::vec3 &bMin, const glm::vec3 &bMax) {
+        return aMin.x <= bMax.x && aMax.x >= bMin.x && aMin.y <= bMax.y && aMax.y >= bMin.y &&
+               aMin.z <= bMax.z && aMax.z >= bMin.z;
+    }
+    // Entry distance of a ray into a box (slab test), or infinity when it misses within maxDistance
+    static float rayBox(const glm::vec3 &origin, const glm::vec3 &inverse, const glm::vec3 &min, const glm::vec3 &max,
+                        float maxDistance) {
+        float tEnter = 0.0f, tExit = maxDistance;
+        for (int axis = 0; axis < 3; axis++) {
+            float t0 = (min[axis] - origin[axis]) * inverse[axis];
+            float t1 = (max[axis] - origin[axis]) * inverse[axis];
+            tEnter = std::max(tEnter, std::min(t0, t1));
+            tExit = std::min(tExit, std::max(t0, t1));
+        }
+        return tEnter <= tExit ? tEnter : std::numeric_limits<float>::infinity();
+    }
+    // False when the box is outside one of the planes still set in planes. Clears the planes the
+    // box is entirely inside of, which then hold for everything within it
+    static bool classifyBox(const Frustum &frustum, const glm::vec3 &center, const glm::vec3 &extent, uint32_t &planes) {
+        for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+            if (!(planes & (1u << p)))
+                continue;
+            const glm::vec4 &plane = frustum.planes[p];
+            float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            float radius = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+            if (distance + radius < 0.0f)
+                return false;
+            if (distance - radius >= 0.0f)
+                planes &= ~(1u << p);
+        }
+        return true;
+    }
+
+    void updateNodeBounds(std::vector<Node> &tree, size_t index) const {
+        Node &node = tree[index];
+        glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+        for (uint32_t k = node.leftOrFirst; k < node.leftOrFirst + node.count; k++) {
+            lo = glm::min(lo, work[k].min);
+            hi = glm::max(hi, work[k].max);
+        }
+        node.min = lo;
+        node.max = hi;
+    }
+
+    void centroidBounds(size_t begin, size_t end, glm::vec3 &lo, glm::vec3 &hi) const {
+        lo = glm::vec3(std::numeric_limits<float>::max());
+        hi = glm::vec3(-std::numeric_limits<float>::max());
+        for (size_t k = begin; k < end; k++) {
+            glm::vec3 centroid = (work[k].min + work[k].max) * 0.5f;
+            lo = glm::min(lo, centroid);
+            hi = glm::max(hi, centroid);
+        }
+    }
+    // Bins per unit of centroid position; 0 on axes where every centroid is the same
+    static glm::vec3 binScale(const glm::vec3 &lo, const glm::vec3 &hi) {
+        glm::vec3 scale;
+        for (int axis = 0; axis < 3; axis++)
+            scale[axis] = hi[axis] > lo[axis] ? SAH_BINS / (hi[axis] - lo[axis]) : 0.0f;
+        return scale;
+    }
+    void binCentroids(size_t begin, size_t end, const glm::vec3 &lo, const glm::vec3 &scale, Bins &bins) const {
+        for (size_t k = begin; k < end; k++) {
+            const BuildObject &object = work[k];
+            glm::vec3 centroid = (object.min + object.max) * 0.5f;
+            for (int axis = 0; axis < 3; axis++) {
+                Bin &bin = bins.bins[axis][std::min(SAH_BINS - 1, (int)((centroid[axis] - lo[axis]) * scale[axis]))];
+                bin.min = glm::min(bin.min, object.min);
+                bin.max = glm::max(bin.max, object.max);
+                bin.count++;
+            }
+        }
+    }
+
+    // Split a leaf node of tree in place, recursively. Nodes holding no more than taskObjects are
+    // not split but recorded in tasks, to be built separately
+    void subdivide(std::vector<Node> &tree, uint32_t index, int depth, size_t taskObjects, std::vector<Task> *tasks = nullptr) {
+        uint32_t first = tree[index].leftOrFirst, count = tree[index].count;
+        if (tasks && count <= taskObjects) {
+            tasks->push_back(Task{ index, depth });
+            return;
+        }
+        if (count <= MIN_LEAF_SIZE || depth >= MAX_DEPTH)
+            return;
+
+        // Bin object centroids along all three axes and find the cheapest split plane. The top
+        // nodes of a parallel build spread both passes over the pool, as they see every object
+        WorkerPool &workers = WorkerPool::instance();
+        size_t slices = tasks ? workers.chunksFor(count, PARALLEL_BUILD_OBJECTS / 4) : 1;
+        glm::vec3 lo, hi, scale;
+        Bins bins;
+        if (slices == 1) {
+            centroidBounds(first, first + count, lo, hi);
+            scale = binScale(lo, hi);
+            binCentroids(first, first + count, lo, scale, bins);
+        }
+        else {
+            std::vector<glm::vec3> sliceLo(slices), sliceHi(slices);
+            workers.parallelFor(count, slices, [&](size_t begin, size_t end, size_t slice) {
+                centroidBounds(first + begin, first + end, sliceLo[slice], sliceHi[slice]);
+            });
+            lo = sliceLo[0];
+            hi = sliceHi[0];
+            for (size_t slice = 1; slice < slices; slice++) {
+                lo = glm::min(lo, sliceLo[slice]);
+                hi = glm::max(hi, sliceHi[slice]);
+            }
+            scale = binScale(lo, hi);
+            std::vector<Bins> sliceBins(slices);
+            workers.parallelFor(count, slices, [&](size_t begin, size_t end, size_t slice) {
+                binCentroids(first + begin, first + end, lo, scale, sliceBins[slice]);
+            });
+            for (const Bins &partial : sliceBins)
+                bins.merge(partial);
+        }
+        int bestAxis = -1, bestSplit = 0;
+        float bestCost = std::numeric_limits<float>::max();
+        for (int axis = 0; axis < 3; axis++) {
+            if (hi[axis] <= lo[axis])
+                continue;
+            const Bin *axisBins = bins.bins[axis];
+            // Sweep from the right recording each suffix, then from the left evaluating each split
+            float rightArea[SAH_BINS];
+            uint32_t rightCount[SAH_BINS];
+            glm::vec3 rMin = axisBins[SAH_BINS - 1].min, rMax = axisBins[SAH_BINS - 1].max;
+            uint32_t rCount = 0;
+            for (int split = SAH_BINS - 1; split > 0; split--) {
+                rMin = glm::min(rMin, axisBins[split].min);
+                rMax = glm::max(rMax, axisBins[split].max);
+                rCount += axisBins[split].count;
+                rightArea[split] = rCount ? area(rMin, rMax) : 0.0f;
+                rightCount[split] = rCount;
+            }
+            glm::vec3 lMin = axisBins[0].min, lMax = axisBins[0].max;
+            uint32_t lCount = 0;
+            for (int split = 1; split < SAH_BINS; split++) {
+                lMin = glm::min(lMin, axisBins[split - 1].min);
+                lMax = glm::max(lMax, axisBins[split - 1].max);
+                lCount += axisBins[split - 1].count;
+                if (lCount == 0 || rightCount[split] == 0)
+                    continue;
+                float splitCost = lCount * area(lMin, lMax) + rightCount[split] * rightArea[split];
+                if (splitCost < bestCost) {
+                    bestCost = splitCost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        // Leaf when splitting costs more than testing every object (one node visit counts as one test)
+        float parentArea = area(tree[index].min, tree[index].max);
+        float leafCost = (float)count;
+        float splitCost = parentArea > 0.0f ? 1.0f + bestCost / parentArea : leafCost;
+        uint32_t leftCount;
+        if (bestAxis >= 0 && (splitCost < leafCost || count > MAX_LEAF_SIZE)) {
+            float axisScale = scale[bestAxis], axisLow = lo[bestAxis];
+            BuildObject *begin = &work[first];
+            BuildObject *middle = std::partition(begin, begin + count, [&](const BuildObject &object) {
+                float centroid = (object.min[bestAxis] + object.max[bestAxis]) * 0.5f;
+                return std::min(SAH_BINS - 1, (int)((centroid - axisLow) * axisScale)) < bestSplit;
+            });
+            leftCount = (uint32_t)(middle - begin);
+        }
+        else if (count > MAX_LEAF_SIZE) {
+            // Every centroid in one spot: no plane separates them, so halve the list
+            leftCount = count / 2;
+        }
+        else {
+            return;
+        }
+
+        uint32_t left = (uint32_t)tree.size();
+        tree.push_back(Node());
+        tree.push_back(Node());
+        tree[left].leftOrFirst = first;
+        tree[left].count = leftCount;
+        tree[left + 1].leftOrFirst = first + leftCount;
+        tree[left + 1].count = count - leftCount;
+        tree[index].leftOrFirst = left;
+        tree[index].count = 0;
+        updateNodeBounds(tree, left);
+        updateNodeBounds(tree, left + 1);
+        subdivide(tree, left, depth + 1, taskObjects, tasks);
+        subdivide(tree, left + 1, depth + 1, taskObjects, tasks);
+    }
+
+    // Put a subtree built separately (root at local[0]) in place of node index. The rest of it
+    // goes at the end of the array, so children still follow their parents
+    void appendSubtree(uint32_t index, std::vector<Node> &local) {
+        uint32_t base = (uint32_t)nodes.size();
+        for (Node &node : local) {
+            if (!node.isLeaf())
+                node.leftOrFirst = base + node.leftOrFirst - 1;
+        }
+        nodes[index] = local[0];
+        nodes.insert(nodes.end(), local.begin() + 1, local.end());
+    }
+
+    // Surface area heuristic cost of the whole tree, relative to the root's area
+    float sahCost() const {
+        float rootArea = area(nodes[0].min, nodes[0].max);
+        if (rootArea <= 0.0f)
+            return (float)objectCount();
+        float total = 0.0f;
+        for (const Node &node : nodes)
+            total += area(node.min, node.max) * (node.isLeaf() ? (float)node.count : 1.0f);
+        return total / rootArea;
+    }
+};
+
+#endif
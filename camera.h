@@ -8,6 +8,8 @@
 
 #include <vector>
 
+#include "frustum.h"
+
 // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
 enum Camera_Movement {
     FORWARD,
@@ -66,6 +68,11 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // Returns the six normalized world-space frustum planes for the given projection and the current view
+    Frustum GetFrustum(const glm::mat4 &projection) {
+        return Frustum::fromMatrix(projection * GetViewMatrix());
+    }
+
     // Processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime) {
         float velocity = MovementSpeed * deltaTime;
@@ -0,0 +1,408 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "shader.h"
+#include "gl_state.h"
+#include "mesh_pool.h"
+#include "instance_buffer.h"
+
+// Bump allocator over a list of fixed-size blocks. reset() rewinds without freeing, so after the
+// first few frames recording allocates nothing. Not thread-safe: each recording thread owns one
+class LinearAllocator {
+public:
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size = 0;
+        size_t used = 0;
+    };
+
+    explicit LinearAllocator(size_t blockSize = 64 * 1024) : blockSize(blockSize) {}
+    LinearAllocator(LinearAllocator&&) = default;
+    LinearAllocator &operator=(LinearAllocator&&) = default;
+
+    // Never fails; a request larger than the block size gets a block of its own.
+    // alignment must be a power of two no larger than alignof(std::max_align_t)
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        while (current < blocks.size()) {
+            Block &block = blocks[current];
+            size_t start = (block.used + alignment - 1) & ~(alignment - 1);
+            if (start + size <= block.size) {
+                block.used = start + size;
+                return block.data.get() + start;
+            }
+            current++;
+        }
+        Block block;
+        block.size = std::max(size, blockSize);
+        block.data.reset(new unsigned char[block.size]);
+        block.used = size;
+        blocks.push_back(std::move(block));
+        current = blocks.size() - 1;
+        return blocks.back().data.get();
+    }
+
+    void reset() {
+        for (Block &block : blocks)
+            block.used = 0;
+        current = 0;
+    }
+
+    // Blocks in allocation order; only the first used bytes of each hold data
+    const std::vector<Block> &usedBlocks() const {
+        return blocks;
+    }
+    size_t bytesUsed() const {
+        size_t bytes = 0;
+        for (const Block &block : blocks)
+            bytes += block.used;
+        return bytes;
+    }
+
+private:
+    size_t blockSize;
+    std::vector<Block> blocks;
+    size_t current = 0;
+};
+
+// Recorded rendering work in a flat, API-agnostic format: commands name programs, meshes and
+// textures by engine handle and carry plain values, and only CommandReplay turns them into GL
+// calls. Worker threads can therefore record into their own buffers in parallel, and the thread
+// that owns the context replays the buffers in order.
+//
+// Each command is a CommandHeader followed by its payload, packed back to back in the buffer's
+// linear allocator at 8-byte alignment
+class CommandBuffer {
+public:
+    enum CommandType : uint16_t {
+        CMD_BIND_PROGRAM,
+        CMD_SET_UNIFORM,
+        CMD_BIND_TEXTURE,
+        CMD_SET_BLEND,
+        CMD_BIND_VERTEX_ARRAY,
+        CMD_DRAW_INDEXED,
+        CMD_DRAW_MESH,
+        CMD_BEGIN_CONDITIONAL,
+        CMD_END_CONDITIONAL,
+    };
+    enum UniformType : uint8_t {
+        UNIFORM_INT,
+        UNIFORM_FLOAT,
+        UNIFORM_VEC3,
+        UNIFORM_VEC4,
+        UNIFORM_MAT3,
+        UNIFORM_MAT4,
+    };
+
+    struct CommandHeader {
+        CommandType type;
+        // Bytes to the next command, header included
+        uint16_t size;
+    };
+    struct BindProgram {
+        static const CommandType TYPE = CMD_BIND_PROGRAM;
+        CommandHeader header;
+        Shader *program;
+    };
+    // Applies to the program of the last CMD_BIND_PROGRAM. The value follows the command
+    struct SetUniform {
+        static const CommandType TYPE = CMD_SET_UNIFORM;
+        CommandHeader header;
+        Shader::Uniform uniform;
+        UniformType type;
+        const void *value() const {
+            return this + 1;
+        }
+    };
+    struct BindTexture {
+        static const CommandType TYPE = CMD_BIND_TEXTURE;
+        CommandHeader header;
+        uint32_t unit;
+        uint32_t texture;
+    };
+    struct SetBlend {
+        static const CommandType TYPE = CMD_SET_BLEND;
+        CommandHeader header;
+        bool enabled;
+    };
+    struct BindVertexArray {
+        static const CommandType TYPE = CMD_BIND_VERTEX_ARRAY;
+        CommandHeader header;
+        uint32_t vertexArray;
+    };
+    // Triangles from the bound vertex array's index buffer; indexSize is 2 or 4 bytes
+    struct DrawIndexed {
+        static const CommandType TYPE = CMD_DRAW_INDEXED;
+        CommandHeader header;
+        uint32_t indexSize;
+        uint32_t count;
+        uint32_t firstIndex;
+        int32_t baseVertex;
+        uint32_t instanceCount;
+    };
+    // A mesh pool draw; consecutive ones with no state change between them submit together
+    struct DrawMesh {
+        static const CommandType TYPE = CMD_DRAW_MESH;
+        CommandHeader header;
+        MeshPool *pool;
+        MeshPool::MeshId mesh;
+        uint32_t instanceCount;
+        uint32_t baseInstance;
+    };
+    // Draws up to the matching CMD_END_CONDITIONAL run only if the occlusion query passed samples.
+    // The GPU waits for the result; the CPU never does
+    struct BeginConditional {
+        static const CommandType TYPE = CMD_BEGIN_CONDITIONAL;
+        CommandHeader header;
+        uint32_t query;
+    };
+    struct EndConditional {
+        static const CommandType TYPE = CMD_END_CONDITIONAL;
+        CommandHeader header;
+    };
+
+    explicit CommandBuffer(size_t blockSize = 64 * 1024) : memory(blockSize) {}
+
+    // Drop every command, keeping the memory for the next recording
+    void reset() {
+        memory.reset();
+        commandCount = 0;
+    }
+    size_t size() const {
+        return commandCount;
+    }
+    size_t bytes() const {
+        return memory.bytesUsed();
+    }
+
+    void bindProgram(Shader *program) {
+        push<BindProgram>().program = program;
+    }
+    void setUniform(Shader::Uniform uniform, int value) {
+        pushUniform(uniform, UNIFORM_INT, &value, sizeof(value));
+    }
+    void setUniform(Shader::Uniform uniform, float value) {
+        pushUniform(uniform, UNIFORM_FLOAT, &value, sizeof(value));
+    }
+    void setUniform(Shader::Uniform uniform, const glm::vec3 &value) {
+        pushUniform(uniform, UNIFORM_VEC3, &value[0], 3 * sizeof(float));
+    }
+    void setUniform(Shader::Uniform uniform, const glm::vec4 &value) {
+        pushUniform(uniform, UNIFORM_VEC4, &value[0], 4 * sizeof(float));
+    }
+    void setUniform(Shader::Uniform uniform, const glm::mat3 &value) {
+        pushUniform(uniform, UNIFORM_MAT3, &value[0][0], 9 * sizeof(float));
+    }
+    void setUniform(Shader::Uniform uniform, const glm::mat4 &value) {
+        pushUniform(uniform, UNIFORM_MAT4, &value[0][0], 16 * sizeof(float));
+    }
+    void bindTexture(uint32_t unit, uint32_t texture) {
+        BindTexture &command = push<BindTexture>();
+        command.unit = unit;
+        command.texture = texture;
+    }
+    void setBlend(bool enabled) {
+        push<SetBlend>().enabled = enabled;
+    }
+    void bindVertexArray(uint32_t vertexArray) {
+        push<BindVertexArray>().vertexArray = vertexArray;
+    }
+    void drawIndexed(uint32_t indexSize, uint32_t count, uint32_t firstIndex, int32_t baseVertex = 0, uint32_t instanceCount = 1) {
+        DrawIndexed &command = push<DrawIndexed>();
+        command.indexSize = indexSize;
+        command.count = count;
+        command.firstIndex = firstIndex;
+        command.baseVertex = baseVertex;
+        command.instanceCount = instanceCount;
+    }
+    void drawMesh(MeshPool *pool, MeshPool::MeshId mesh, uint32_t instanceCount = 1, uint32_t baseInstance = 0) {
+        DrawMesh &command = push<DrawMesh>();
+        command.pool = pool;
+        command.mesh = mesh;
+        command.instanceCount = instanceCount;
+        command.baseInstance = baseInstance;
+    }
+    void beginConditional(uint32_t query) {
+        push<BeginConditional>().query = query;
+    }
+    void endConditional() {
+        push<EndConditional>();
+    }
+
+    // Call fn(header) for every command in recording order
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (const LinearAllocator::Block &block : memory.usedBlocks()) {
+            size_t offset = 0;
+            while (offset < block.used) {
+                const CommandHeader *header = reinterpret_cast<const CommandHeader*>(block.data.get() + offset);
+                fn(*header);
+                offset += header->size;
+            }
+        }
+    }
+
+private:
+    static const size_t COMMAND_ALIGNMENT = 8;
+
+    LinearAllocator memory;
+    size_t commandCount = 0;
+
+    // Sizes are rounded up to the alignment so the next command starts right after this one
+    template <typename T>
+    T &push(size_t extra = 0) {
+        size_t size = (sizeof(T) + extra + COMMAND_ALIGNMENT - 1) & ~(COMMAND_ALIGNMENT - 1);
+        T *command = static_cast<T*>(memory.allocate(size, COMMAND_ALIGNMENT));
+        command->header.type = T::TYPE;
+        command->header.size = (uint16_t)size;
+        commandCount++;
+        return *command;
+    }
+    void pushUniform(Shader::Uniform uniform, UniformType type, const void *value, size_t size) {
+        SetUniform &command = push<SetUniform>(size);
+        command.uniform = uniform;
+        command.type = type;
+        memcpy(&command + 1, value, size);
+    }
+};
+
+// Executes command buffers on the thread that owns the GL context. Program, texture, blend and
+// vertex array changes go through the shader's and glState()'s redundancy filters. Mesh pool draws
+// are queued in their pool and submitted together at the next state change or at finish(), so
+// draws recorded into different buffers still merge into one multi-draw
+class CommandReplay {
+public:
+    struct Stats {
+        int buffers = 0;
+        int commands = 0;
+        size_t bytes = 0;
+    };
+    Stats stats;
+
+    // instances is the buffer the pools' vertex arrays read instance attributes from
+    explicit CommandReplay(InstanceBuffer *instances = nullptr) : instances(instances) {}
+
+    void execute(const CommandBuffer &commands) {
+        stats.buffers++;
+        stats.commands += (int)commands.size();
+        stats.bytes += commands.bytes();
+        commands.forEach([this](const CommandBuffer::CommandHeader &header) { run(header); });
+    }
+
+    // Submit pool draws still queued. Call after the frame's last buffer
+    void finish() {
+        if (pendingPool)
+            pendingPool->submit(instances);
+        pendingPool = nullptr;
+        program = nullptr;
+    }
+
+    void resetStats() {
+        stats = Stats();
+    }
+
+private:
+    InstanceBuffer *instances;
+    Shader *program = nullptr;
+    MeshPool *pendingPool = nullptr;
+
+    template <typename T>
+    static const T &as(const CommandBuffer::CommandHeader &header) {
+        return *reinterpret_cast<const T*>(&header);
+    }
+
+    void run(const CommandBuffer::CommandHeader &header) {
+        if (header.type == CommandBuffer::CMD_DRAW_MESH) {
+            const CommandBuffer::DrawMesh &command = as<CommandBuffer::DrawMesh>(header);
+            if (pendingPool && pendingPool != command.pool)
+                pendingPool->submit(instances);
+            pendingPool = command.pool;
+            command.pool->draw(command.mesh, command.instanceCount, command.baseInstance);
+            return;
+        }
+        // Anything else may change state the queued draws depend on
+        if (pendingPool) {
+            pendingPool->submit(instances);
+            pendingPool = nullptr;
+        }
+        switch (header.type) {
+            case CommandBuffer::CMD_BIND_PROGRAM:
+                program = as<CommandBuffer::BindProgram>(header).program;
+                program->use();
+                break;
+            case CommandBuffer::CMD_SET_UNIFORM:
+                if (program)
+                    setUniform(as<CommandBuffer::SetUniform>(header));
+                break;
+            case CommandBuffer::CMD_BIND_TEXTURE: {
+                const CommandBuffer::BindTexture &command = as<CommandBuffer::BindTexture>(header);
+                glState().bindTexture(command.unit, command.texture);
+                break;
+            }
+            case CommandBuffer::CMD_SET_BLEND:
+                glState().setEnabled(GL_BLEND, as<CommandBuffer::SetBlend>(header).enabled);
+                break;
+            case CommandBuffer::CMD_BIND_VERTEX_ARRAY:
+                glState().bindVertexArray(as<CommandBuffer::BindVertexArray>(header).vertexArray);
+                break;
+            case CommandBuffer::CMD_DRAW_INDEXED: {
+                const CommandBuffer::DrawIndexed &command = as<CommandBuffer::DrawIndexed>(header);
+                GLenum indexType = command.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, indexType,
+                                                  (void*)((size_t)command.firstIndex * command.indexSize),
+                                                  command.instanceCount, command.baseVertex);
+                break;
+            }
+            case CommandBuffer::CMD_BEGIN_CONDITIONAL:
+                glBeginConditionalRender(as<CommandBuffer::BeginConditional>(header).query, GL_QUERY_WAIT);
+                break;
+            case CommandBuffer::CMD_END_CONDITIONAL:
+                glEndConditionalRender();
+                break;
+            default:
+                break;
+        }
+    }
+
+    void setUniform(const CommandBuffer::SetUniform &command) {
+        // The payload is only as long as its type; copy out as much as that
+        static const size_t sizes[] = { sizeof(int), sizeof(float), 3 * sizeof(float), 4 * sizeof(float),
+                                        9 * sizeof(float), 16 * sizeof(float) };
+        float value[16];
+        memcpy(value, command.value(), sizes[command.type]);
+        switch (command.type) {
+            case CommandBuffer::UNIFORM_INT: {
+                int i;
+                memcpy(&i, value, sizeof(i));
+                program->setInt(command.uniform, i);
+                break;
+            }
+            case CommandBuffer::UNIFORM_FLOAT: program->setFloat(command.uniform, value[0]); break;
+            case CommandBuffer::UNIFORM_VEC3:  program->setVec3(command.uniform, glm::vec3(value[0], value[1], value[2])); break;
+            case CommandBuffer::UNIFORM_VEC4:  program->setVec4(command.uniform, glm::vec4(value[0], value[1], value[2], value[3])); break;
+            case CommandBuffer::UNIFORM_MAT3: {
+                glm::mat3 mat;
+                memcpy(&mat[0][0], value, sizeof(mat));
+                program->setMat3(command.uniform, mat);
+                break;
+            }
+            case CommandBuffer::UNIFORM_MAT4: {
+                glm::mat4 mat;
+                memcpy(&mat[0][0], value, sizeof(mat));
+                program->setMat4(command.uniform, mat);
+                break;
+            }
+        }
+    }
+};
+
+#endif
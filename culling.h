@@ -0,0 +1,257 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "frustum.h"
+#include "vertex_format.h"
+#include "worker_pool.h"
+
+// AVX2 needs it enabled at compile time (-mavx2 or -march=haswell); SSE is always there on x86-64
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FRUSTUM_CULL_AVX2 1
+#elif defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FRUSTUM_CULL_SSE 1
+#endif
+
+enum CullShape {
+    // Axis-aligned boxes, center and extent
+    CULL_BOXES,
+    // Bounding spheres, center and radius
+    CULL_SPHERES,
+};
+
+// World-space bounds of every object in structure-of-arrays form, so the kernels load each
+// component of 8 (AVX2) or 4 (SSE) objects with one instruction
+struct CullBounds {
+    std::vector<float> centerX, centerY, centerZ;
+    // Box half sizes
+    std::vector<float> extentX, extentY, extentZ;
+    // Sphere radius, length(extent) unless set otherwise
+    std::vector<float> radius;
+
+    size_t size() const {
+        return centerX.size();
+    }
+    void resize(size_t count) {
+        for (std::vector<float> *component : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius })
+            component->resize(count);
+    }
+    void set(size_t i, const MeshBounds &bounds) {
+        centerX[i] = bounds.center.x;
+        centerY[i] = bounds.center.y;
+        centerZ[i] = bounds.center.z;
+        extentX[i] = bounds.extent.x;
+        extentY[i] = bounds.extent.y;
+        extentZ[i] = bounds.extent.z;
+        radius[i] = glm::length(bounds.extent);
+    }
+};
+
+// Box bounds after an affine transform: the new extent along each axis is the absolute matrix
+// applied to the old extent (Arvo)
+inline MeshBounds transformBounds(const MeshBounds &bounds, const glm::mat4 &model) {
+    MeshBounds world;
+    world.center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+    world.extent = glm::vec3(0.0f);
+    for (int column = 0; column < 3; column++) {
+        glm::vec3 axis(model[column]);
+        world.extent += glm::vec3(std::abs(axis.x), std::abs(axis.y), std::abs(axis.z)) * bounds.extent[column];
+    }
+    return world;
+}
+
+// Every kernel below writes the indices of objects [begin, end) that intersect the frustum to
+// visible, in ascending order, and returns how many there are. An object is culled when it lies
+// entirely behind one plane: dot(normal, center) + w + radius < 0, with radius the box's extent
+// projected on the plane normal for boxes. visible must have room for end - begin indices; a
+// kernel never writes past that, so disjoint ranges can share one array
+
+inline size_t cullScalar(const Frustum &frustum, const CullBounds &bounds, CullShape shape,
+                         size_t begin, size_t end, uint32_t *visible) {
+    size_t count = 0;
+    for (size_t i = begin; i < end; i++) {
+        bool inside = true;
+        for (const glm::vec4 &plane : frustum.planes) {
+            float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+            float radius = shape == CULL_SPHERES ? bounds.radius[i]
+                         : std::abs(plane.x) * bounds.extentX[i] + std::abs(plane.y) * bounds.extentY[i] + std::abs(plane.z) * bounds.extentZ[i];
+            inside = inside && distance + radius >= 0.0f;
+        }
+        // Write unconditionally and advance only when visible, so there is no branch to mispredict
+        visible[count] = (uint32_t)i;
+        count += inside;
+    }
+    return count;
+}
+
+#if defined(FRUSTUM_CULL_AVX2)
+// Lane indices that move the set lanes of an 8-bit mask to the front, for each mask
+struct LeftPackTable {
+    alignas(32) uint32_t lanes[256][8];
+    uint8_t counts[256];
+
+    LeftPackTable() {
+        for (int mask = 0; mask < 256; mask++) {
+            int count = 0;
+            for (int lane = 0; lane < 8; lane++) {
+                if (mask & (1 << lane))
+                    lanes[mask][count++] = (uint32_t)lane;
+            }
+            for (int lane = count; lane < 8; lane++)
+                lanes[mask][lane] = 0;
+            counts[mask] = (uint8_t)count;
+        }
+    }
+    static const LeftPackTable &instance() {
+        static const LeftPackTable table;
+        return table;
+    }
+};
+
+template <CullShape Shape>
+inline size_t cullAVX2(const Frustum &frustum, const CullBounds &bounds, size_t begin, size_t end, uint32_t *visible) {
+    const LeftPackTable &pack = LeftPackTable::instance();
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+    for (int p = 0; p < 6; p++) {
+        const glm::vec4 &plane = frustum.planes[p];
+        planeX[p] = _mm256_set1_ps(plane.x);
+        planeY[p] = _mm256_set1_ps(plane.y);
+        planeZ[p] = _mm256_set1_ps(plane.z);
+        planeW[p] = _mm256_set1_ps(plane.w);
+        absX[p] = _mm256_set1_ps(std::abs(plane.x));
+        absY[p] = _mm256_set1_ps(std::abs(plane.y));
+        absZ[p] = _mm256_set1_ps(std::abs(plane.z));
+    }
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    size_t count = 0;
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 cx = _mm256_loadu_ps(&bounds.centerX[i]);
+        __m256 cy = _mm256_loadu_ps(&bounds.centerY[i]);
+        __m256 cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+        __m256 ex, ey, ez, radius;
+        if (Shape == CULL_SPHERES) {
+            radius = _mm256_loadu_ps(&bounds.radius[i]);
+        }
+        else {
+            ex = _mm256_loadu_ps(&bounds.extentX[i]);
+            ey = _mm256_loadu_ps(&bounds.extentY[i]);
+            ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+        }
+        __m256 outside = zero;
+        for (int p = 0; p < 6; p++) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], cx), _mm256_mul_ps(planeY[p], cy)),
+                                                          _mm256_mul_ps(planeZ[p], cz)), planeW[p]);
+            if (Shape == CULL_BOXES)
+                radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absX[p], ex), _mm256_mul_ps(absY[p], ey)), _mm256_mul_ps(absZ[p], ez));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+        }
+        int mask = ~_mm256_movemask_ps(outside) & 0xFF;
+        // All 8 lanes are stored, but only the first count are kept; the rest land at or before
+        // index i + 7 of this range, which is still ours
+        __m256i indices = _mm256_add_epi32(_mm256_set1_epi32((int)i), laneOffsets);
+        __m256i order = _mm256_load_si256(reinterpret_cast<const __m256i*>(pack.lanes[mask]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(visible + count), _mm256_permutevar8x32_epi32(indices, order));
+        count += pack.counts[mask];
+    }
+    return count + cullScalar(frustum, bounds, Shape, i, end, visible + count);
+}
+#endif
+
+#if defined(FRUSTUM_CULL_SSE)
+template <CullShape Shape>
+inline size_t cullSSE(const Frustum &frustum, const CullBounds &bounds, size_t begin, size_t end, uint32_t *visible) {
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+    for (int p = 0; p < 6; p++) {
+        const glm::vec4 &plane = frustum.planes[p];
+        planeX[p] = _mm_set1_ps(plane.x);
+        planeY[p] = _mm_set1_ps(plane.y);
+        planeZ[p] = _mm_set1_ps(plane.z);
+        planeW[p] = _mm_set1_ps(plane.w);
+        absX[p] = _mm_set1_ps(std::abs(plane.x));
+        absY[p] = _mm_set1_ps(std::abs(plane.y));
+        absZ[p] = _mm_set1_ps(std::abs(plane.z));
+    }
+    const __m128 zero = _mm_setzero_ps();
+    size_t count = 0;
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 ex, ey, ez, radius;
+        if (Shape == CULL_SPHERES) {
+            radius = _mm_loadu_ps(&bounds.radius[i]);
+        }
+        else {
+            ex = _mm_loadu_ps(&bounds.extentX[i]);
+            ey = _mm_loadu_ps(&bounds.extentY[i]);
+            ez = _mm_loadu_ps(&bounds.extentZ[i]);
+        }
+        __m128 outside = zero;
+        for (int p = 0; p < 6; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+                                                    _mm_mul_ps(planeZ[p], cz)), planeW[p]);
+            if (Shape == CULL_BOXES)
+                radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)), _mm_mul_ps(absZ[p], ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        }
+        int mask = ~_mm_movemask_ps(outside) & 0xF;
+        for (int lane = 0; lane < 4; lane++) {
+            visible[count] = (uint32_t)(i + lane);
+            count += (mask >> lane) & 1;
+        }
+    }
+    return count + cullScalar(frustum, bounds, Shape, i, end, visible + count);
+}
+#endif
+
+// Widest kernel the build has
+inline size_t cullRange(const Frustum &frustum, const CullBounds &bounds, CullShape shape,
+                        size_t begin, size_t end, uint32_t *visible) {
+#if defined(FRUSTUM_CULL_AVX2)
+    return shape == CULL_SPHERES ? cullAVX2<CULL_SPHERES>(frustum, bounds, begin, end, visible)
+                                 : cullAVX2<CULL_BOXES>(frustum, bounds, begin, end, visible);
+#elif defined(FRUSTUM_CULL_SSE)
+    return shape == CULL_SPHERES ? cullSSE<CULL_SPHERES>(frustum, bounds, begin, end, visible)
+                                 : cullSSE<CULL_BOXES>(frustum, bounds, begin, end, visible);
+#else
+    return cullScalar(frustum, bounds, shape, begin, end, visible);
+#endif
+}
+
+// Cull every object across the worker pool. visible must hold bounds.size() indices; the first
+// count returned are the visible objects, ascending. Each slice culls in place in its own part
+// of visible, then the slices are moved down to close the gaps
+inline size_t cullParallel(const Frustum &frustum, const CullBounds &bounds, CullShape shape, uint32_t *visible,
+                           size_t minObjects = 32 * 1024) {
+    WorkerPool &workers = WorkerPool::instance();
+    size_t objects = bounds.size();
+    size_t slices = workers.chunksFor(objects, minObjects);
+    if (slices == 1)
+        return cullRange(frustum, bounds, shape, 0, objects, visible);
+    std::vector<size_t> found(slices);
+    workers.parallelFor(objects, slices, [&](size_t begin, size_t end, size_t slice) {
+        found[slice] = cullRange(frustum, bounds, shape, begin, end, visible + begin);
+    });
+    size_t count = found[0];
+    for (size_t slice = 1; slice < slices; slice++) {
+        size_t begin = objects * slice / slices;
+        if (begin != count)
+            memmove(visible + count, visible + begin, found[slice] * sizeof(uint32_t));
+        count += found[slice];
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <climits>
+#else
+#include <sys/stat.h>
+#include <chrono>
+#endif
+
+// Reports edits to a set of files without blocking. Uses inotify on Linux and falls back to
+// polling modification times elsewhere (rate limited so the per-frame call stays cheap)
+class FileWatcher {
+public:
+    FileWatcher() {
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    }
+    ~FileWatcher() {
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher &operator=(const FileWatcher&) = delete;
+
+    void watch(const std::string &path) {
+        Entry entry;
+        entry.path = path;
+        size_t slash = path.rfind('/');
+        entry.directory = slash == std::string::npos ? "." : path.substr(0, slash);
+        entry.name = slash == std::string::npos ? path : path.substr(slash + 1);
+#ifdef __linux__
+        // Watch the directory rather than the file: editors often save by writing a new file and
+        // renaming it over the old one, which would drop a watch on the file itself
+        entry.wd = -1;
+        for (const Entry &other : entries) {
+            if (other.directory == entry.directory)
+                entry.wd = other.wd;
+        }
+        if (entry.wd < 0 && fd >= 0)
+            entry.wd = inotify_add_watch(fd, entry.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+#else
+        entry.mtime = modificationTime(path);
+#endif
+        entries.push_back(entry);
+    }
+
+    // Paths passed to watch() that changed since the last call, each reported once
+    std::vector<std::string> poll() {
+        std::vector<std::string> changed;
+#ifdef __linux__
+        if (fd < 0)
+            return changed;
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+            for (char *p = buffer; p < buffer + length; ) {
+                const inotify_event *event = reinterpret_cast<const inotify_event*>(p);
+                for (const Entry &entry : entries) {
+                    if (event->wd == entry.wd && event->len > 0 && entry.name == event->name)
+                        addUnique(changed, entry.path);
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+#else
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastPoll < std::chrono::milliseconds(250))
+            return changed;
+        lastPoll = now;
+        for (Entry &entry : entries) {
+            long long mtime = modificationTime(entry.path);
+            if (mtime != entry.mtime) {
+                entry.mtime = mtime;
+                addUnique(changed, entry.path);
+            }
+        }
+#endif
+        return changed;
+    }
+
+private:
+    struct Entry {
+        std::string path;
+        std::string directory;
+        std::string name;
+#ifdef __linux__
+        int wd;
+#else
+        long long mtime;
+#endif
+    };
+    std::vector<Entry> entries;
+
+#ifdef __linux__
+    int fd = -1;
+#else
+    std::chrono::steady_clock::time_point lastPoll;
+
+    static long long modificationTime(const std::string &path) {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return 0;
+#ifdef __APPLE__
+        return (long long)info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+        return (long long)info.st_mtime;
+#endif
+    }
+#endif
+
+    static void addUnique(std::vector<std::string> &paths, const std::string &path) {
+        if (std::find(paths.begin(), paths.end(), path) == paths.end())
+            paths.push_back(path);
+    }
+};
+
+#endif
@@ -0,0 +1,6 @@
+// Per-frame camera data shared by all programs, see FrameData in uniform_buffer.h
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+};
@@ -0,0 +1,53 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// View frustum as six inward-facing planes (xyz normal, w distance): a point p is inside a plane
+// when dot(xyz, p) + w >= 0. Normals are unit length, so plane distances are in world units and
+// sphere radii can be compared against them directly
+struct Frustum {
+    enum Plane { PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR, PLANE_COUNT };
+    glm::vec4 planes[PLANE_COUNT];
+
+    // Planes of a projection * view matrix in world space (Gribb/Hartmann): each is the last row
+    // of the matrix plus or minus one of the others, for GL's -w..w clip volume
+    static Frustum fromMatrix(const glm::mat4 &viewProjection) {
+        // glm is column-major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        Frustum frustum;
+        frustum.planes[PLANE_LEFT] = rows[3] + rows[0];
+        frustum.planes[PLANE_RIGHT] = rows[3] - rows[0];
+        frustum.planes[PLANE_BOTTOM] = rows[3] + rows[1];
+        frustum.planes[PLANE_TOP] = rows[3] - rows[1];
+        frustum.planes[PLANE_NEAR] = rows[3] + rows[2];
+        frustum.planes[PLANE_FAR] = rows[3] - rows[2];
+        for (glm::vec4 &plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    bool intersectsSphere(const glm::vec3 &center, float radius) const {
+        for (const glm::vec4 &plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w + radius < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    // Conservative: a box near a frustum corner can pass while lying outside it
+    bool intersectsBox(const glm::vec3 &center, const glm::vec3 &extent) const {
+        for (const glm::vec4 &plane : planes) {
+            float radius = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+            if (glm::dot(glm::vec3(plane), center) + plane.w + radius < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef GL_EXT_H
+#define GL_EXT_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// Entry points and enums newer than the GL 3.3 core profile glad was generated for.
+// Call glext::load() after gladLoadGLLoader; every pointer is null when the driver lacks it
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+#ifndef GL_CLIENT_STORAGE_BIT
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+namespace glext {
+
+typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+typedef void (APIENTRYP DrawElementsInstancedBaseVertexBaseInstanceProc)(GLenum mode, GLsizei count, GLenum type, const void *indices,
+                                                                         GLsizei instancecount, GLint basevertex, GLuint baseinstance);
+
+inline GetProgramBinaryProc GetProgramBinary = nullptr;
+inline ProgramBinaryProc ProgramBinary = nullptr;
+inline ProgramParameteriProc ProgramParameteri = nullptr;
+inline MaxShaderCompilerThreadsProc MaxShaderCompilerThreads = nullptr;
+inline BufferStorageProc BufferStorage = nullptr;
+inline MultiDrawElementsIndirectProc MultiDrawElementsIndirect = nullptr;
+inline DrawElementsInstancedBaseVertexBaseInstanceProc DrawElementsInstancedBaseVertexBaseInstance = nullptr;
+
+// Texture formats with no entry points of their own: glCompressedTexImage2D is core
+inline bool S3TC = false;
+inline bool BPTC = false;
+
+// True when the context is at least major.minor
+inline bool hasVersion(int major, int minor) {
+    GLint contextMajor = 0, contextMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+// True when the driver advertises the named extension
+inline bool hasExtension(const char *name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+        if (extension && strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Program binaries: core in 4.1, ARB_get_program_binary before that. Drivers may still expose no formats
+inline bool programBinarySupported() {
+    if (!GetProgramBinary || !ProgramBinary || !ProgramParameteri)
+        return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// KHR/ARB_parallel_shader_compile: compiles run on driver threads and GL_COMPLETION_STATUS_KHR
+// can be polled without blocking
+inline bool parallelShaderCompileSupported() {
+    return MaxShaderCompilerThreads != nullptr;
+}
+
+// Immutable buffer storage: core in 4.4, ARB_buffer_storage before that. Allows persistent mappings
+inline bool bufferStorageSupported() {
+    return BufferStorage != nullptr;
+}
+
+// EXT_texture_compression_s3tc: BC1 to BC3. Never core, but on practically every desktop driver
+inline bool s3tcSupported() {
+    return S3TC;
+}
+
+// BC6H and BC7: core in 4.2, ARB_texture_compression_bptc before that
+inline bool bptcSupported() {
+    return BPTC;
+}
+
+inline void load(GLADloadproc loader) {
+    if (hasVersion(4, 1) || hasExtension("GL_ARB_get_program_binary")) {
+        GetProgramBinary = (GetProgramBinaryProc)loader("glGetProgramBinary");
+        ProgramBinary = (ProgramBinaryProc)loader("glProgramBinary");
+        ProgramParameteri = (ProgramParameteriProc)loader("glProgramParameteri");
+    }
+    if (hasExtension("GL_KHR_parallel_shader_compile"))
+        MaxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsKHR");
+    else if (hasExtension("GL_ARB_parallel_shader_compile"))
+        MaxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsARB");
+    if (hasVersion(4, 4) || hasExtension("GL_ARB_buffer_storage"))
+        BufferStorage = (BufferStorageProc)loader("glBufferStorage");
+    // Multi-draw indirect (4.3) builds on draw indirect (4.0) and base instance (4.2)
+    if (hasVersion(4, 2) || hasExtension("GL_ARB_base_instance"))
+        DrawElementsInstancedBaseVertexBaseInstance = (DrawElementsInstancedBaseVertexBaseInstanceProc)loader("glDrawElementsInstancedBaseVertexBaseInstance");
+    if (hasVersion(4, 3) || (hasExtension("GL_ARB_multi_draw_indirect") && hasExtension("GL_ARB_draw_indirect") && DrawElementsInstancedBaseVertexBaseInstance))
+        MultiDrawElementsIndirect = (MultiDrawElementsIndirectProc)loader("glMultiDrawElementsIndirect");
+    S3TC = hasExtension("GL_EXT_texture_compression_s3tc");
+    BPTC = hasVersion(4, 2) || hasExtension("GL_ARB_texture_compression_bptc");
+    // Let the driver pick its own thread count
+    if (MaxShaderCompilerThreads)
+        MaxShaderCompilerThreads(0xFFFFFFFFu);
+}
+
+}
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+// Shadow of the GL binding and capability state the renderer touches. Every change goes through
+// here so a bind of what is already bound costs nothing; real vs elided calls are counted per frame.
+// Only valid while all state changes for these bindings are routed through this cache
+class GLState {
+public:
+    static const int MAX_TEXTURE_UNITS = 16;
+    static constexpr GLuint UNKNOWN = 0xFFFFFFFFu;
+
+    struct Stats {
+        int issued = 0;
+        int elided = 0;
+    };
+    Stats stats;
+
+    GLState() {
+        invalidate();
+    }
+
+    // Forget everything, e.g. after code outside the cache changed GL state
+    void invalidate() {
+        program = vertexArray = arrayBuffer = elementBuffer = uniformBuffer = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (int i = 0; i < MAX_TEXTURE_UNITS; i++)
+            textures[i] = UNKNOWN;
+        for (int i = 0; i < CAPABILITY_COUNT; i++)
+            capabilities[i] = -1;
+    }
+    void resetStats() {
+        stats = Stats();
+    }
+
+    void useProgram(GLuint id) {
+        if (changed(program, id))
+            glUseProgram(id);
+    }
+    void bindVertexArray(GLuint id) {
+        if (changed(vertexArray, id)) {
+            glBindVertexArray(id);
+            // The element buffer binding belongs to the VAO
+            elementBuffer = UNKNOWN;
+        }
+    }
+    void bindBuffer(GLenum target, GLuint id) {
+        GLuint *cached = target == GL_ARRAY_BUFFER ? &arrayBuffer :
+                         target == GL_ELEMENT_ARRAY_BUFFER ? &elementBuffer :
+                         target == GL_UNIFORM_BUFFER ? &uniformBuffer : nullptr;
+        if (!cached) {
+            glBindBuffer(target, id);
+            stats.issued++;
+        }
+        else if (changed(*cached, id)) {
+            glBindBuffer(target, id);
+        }
+    }
+    // Indexed binding of a range; like glBindBufferBase this also binds the generic target
+    void bindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size) {
+        glBindBufferRange(target, index, id, offset, size);
+        if (target == GL_UNIFORM_BUFFER)
+            uniformBuffer = id;
+        stats.issued++;
+    }
+    void activeTexture(GLuint unit) {
+        if (changed(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+    // 2D texture binding on a given unit
+    void bindTexture(GLuint unit, GLuint id) {
+        if (unit >= MAX_TEXTURE_UNITS) {
+            activeTexture(unit);
+            glBindTexture(GL_TEXTURE_2D, id);
+            stats.issued++;
+            return;
+        }
+        if (textures[unit] == id) {
+            stats.elided++;
+            return;
+        }
+        activeTexture(unit);
+        glBindTexture(GL_TEXTURE_2D, id);
+        textures[unit] = id;
+        stats.issued++;
+    }
+    // GL_DEPTH_TEST, GL_BLEND and GL_CULL_FACE are cached, other capabilities pass through
+    void setEnabled(GLenum capability, bool enabled) {
+        int index = capabilityIndex(capability);
+        if (index >= 0 && capabilities[index] == (int)enabled) {
+            stats.elided++;
+            return;
+        }
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+        if (index >= 0)
+            capabilities[index] = (int)enabled;
+        stats.issued++;
+    }
+
+    // Deleting a bound object reverts its binding to 0
+    void deleteProgram(GLuint id) {
+        glDeleteProgram(id);
+        if (program == id)
+            program = UNKNOWN;
+    }
+    void deleteVertexArray(GLuint id) {
+        glDeleteVertexArrays(1, &id);
+        if (vertexArray == id)
+            vertexArray = 0;
+    }
+    void deleteBuffer(GLuint id) {
+        glDeleteBuffers(1, &id);
+        if (arrayBuffer == id)
+            arrayBuffer = 0;
+        if (elementBuffer == id)
+            elementBuffer = 0;
+        if (uniformBuffer == id)
+            uniformBuffer = 0;
+    }
+    void deleteTexture(GLuint id) {
+        glDeleteTextures(1, &id);
+        for (int i = 0; i < MAX_TEXTURE_UNITS; i++) {
+            if (textures[i] == id)
+                textures[i] = 0;
+        }
+    }
+
+private:
+    static const int CAPABILITY_COUNT = 3;
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint arrayBuffer;
+    GLuint elementBuffer;
+    GLuint uniformBuffer;
+    GLuint activeUnit;
+    GLuint textures[MAX_TEXTURE_UNITS];
+    // -1 unknown, 0 disabled, 1 enabled
+    int capabilities[CAPABILITY_COUNT];
+
+    bool changed(GLuint &cached, GLuint value) {
+        if (cached == value) {
+            stats.elided++;
+            return false;
+        }
+        cached = value;
+        stats.issued++;
+        return true;
+    }
+    static int capabilityIndex(GLenum capability) {
+        switch (capability) {
+            case GL_DEPTH_TEST: return 0;
+            case GL_BLEND:      return 1;
+            case GL_CULL_FACE:  return 2;
+            default:            return -1;
+        }
+    }
+};
+
+// The cache for the one GL context this app uses
+inline GLState &glState() {
+    static GLState state;
+    return state;
+}
+
+#endif
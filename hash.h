@@ -0,0 +1,57 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// FNV-1a string hash. constexpr so uniform names passed as literals can be hashed at compile time
+constexpr uint32_t hashString(const char *str, uint32_t hash = 2166136261u) {
+    return *str ? hashString(str + 1, (hash ^ (uint32_t)(unsigned char)*str) * 16777619u) : hash;
+}
+
+// FNV-1a over a byte range, for names that are not NUL terminated
+inline uint32_t hashBytes(const void *data, size_t size, uint32_t hash = 2166136261u) {
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+// 64-bit FNV-1a for content keys (shader sources, cache entries) where 32 bits would collide too easily
+inline uint64_t hashBytes64(const void *data, size_t size, uint64_t hash = 14695981039346656037ull) {
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    return hash;
+}
+
+// Fast 64-bit hash for large buffers such as decoded images. Four independent lanes take 8-byte
+// words with the xxHash64 round (multiply, rotate, multiply), several bytes per cycle where
+// byte-wise FNV-1a manages one; the tail and the length are folded in at the end
+inline uint64_t hashContent64(const void *data, size_t size, uint64_t seed = 0) {
+    const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+    const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    auto rotate = [](uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); };
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    uint64_t lanes[4] = { seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1 };
+    size_t offset = 0;
+    for (; offset + 32 <= size; offset += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, bytes + offset + lane * 8, sizeof(word));
+            lanes[lane] = rotate(lanes[lane] + word * PRIME2, 31) * PRIME1;
+        }
+    }
+    uint64_t hash = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18);
+    hash = hashBytes64(bytes + offset, size - offset, hash ^ (uint64_t)size);
+    // Final avalanche so every input bit reaches every output bit
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME1;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "gl_state.h"
+#include "stream_buffer.h"
+
+// Attribute locations of the per-instance inputs declared under INSTANCED in shader.vs.
+// A mat4 takes four consecutive locations and a mat3 three
+const GLuint INSTANCE_MODEL_LOCATION = 3;
+const GLuint INSTANCE_NORMAL_MATRIX_LOCATION = 7;
+
+// Per-instance vertex data, tightly packed: 16 floats of model matrix then 9 of normal matrix
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+};
+static_assert(offsetof(InstanceData, normalMatrix) == 64, "normal matrix follows the model matrix");
+static_assert(sizeof(InstanceData) == 100, "instance data is tightly packed");
+
+// CPU copy of every instance plus the vertex buffer the instanced draw reads it from.
+// set() only marks instances whose data actually changed, and upload() sends just the dirty
+// ranges, so a static scene costs no bandwidth after the first frame.
+// Given a StreamBuffer, upload() instead writes every instance into the stream's current frame
+// region and re-points the attributes there, for instances that change most frames
+class InstanceBuffer {
+public:
+    unsigned int ID;
+
+    struct Stats {
+        int uploads = 0;
+        size_t bytes = 0;
+    };
+    Stats stats;
+
+    explicit InstanceBuffer(StreamBuffer *stream = nullptr) : stream(stream) {
+        glGenBuffers(1, &ID);
+    }
+    // Destroy while the GL context is current
+    ~InstanceBuffer() {
+        glState().deleteBuffer(ID);
+    }
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer &operator=(const InstanceBuffer&) = delete;
+
+    size_t size() const {
+        return instances.size();
+    }
+    // Grow or shrink the instance count. New instances are dirty until first uploaded
+    void resize(size_t count) {
+        size_t old = instances.size();
+        instances.resize(count);
+        if (count > old)
+            markDirty(old, count - old);
+        else
+            clampDirty(count);
+    }
+
+    void set(size_t index, const glm::mat4 &model, const glm::mat3 &normalMatrix) {
+        InstanceData &instance = instances[index];
+        if (memcmp(&instance.model, &model, sizeof(model)) == 0 &&
+            memcmp(&instance.normalMatrix, &normalMatrix, sizeof(normalMatrix)) == 0)
+            return;
+        instance.model = model;
+        instance.normalMatrix = normalMatrix;
+        markDirty(index, 1);
+    }
+
+    // For bulk writers that fill instances directly; they must markDirty() what they touch
+    InstanceData *data() {
+        return instances.data();
+    }
+    void markDirty(size_t first, size_t count) {
+        if (count == 0)
+            return;
+        size_t end = first + count;
+        // Writers usually walk instances in order, so most marks extend the last range
+        if (!dirty.empty() && first <= dirty.back().end && end >= dirty.back().begin) {
+            dirty.back().begin = std::min(dirty.back().begin, first);
+            dirty.back().end = std::max(dirty.back().end, end);
+            return;
+        }
+        dirty.push_back(Range{ first, end });
+    }
+
+    // Point the per-instance attributes of a vertex array at this buffer, advancing once per instance
+    void attach(GLuint vertexArray) {
+        attached = vertexArray;
+        pointAttributes(ID, 0);
+    }
+
+    // Send dirty instances to the GPU. Reallocates (and uploads everything) when the count outgrew
+    // the buffer, otherwise one glBufferSubData per merged dirty range
+    void upload() {
+        if (stream && uploadStreamed())
+            return;
+        if (dirty.empty())
+            return;
+        glState().bindBuffer(GL_ARRAY_BUFFER, ID);
+        if (instances.size() > capacity) {
+            capacity = instances.size();
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), instances.data(), GL_DYNAMIC_DRAW);
+            countUpload(capacity);
+            dirty.clear();
+            return;
+        }
+        std::sort(dirty.begin(), dirty.end(), [](const Range &a, const Range &b) { return a.begin < b.begin; });
+        size_t merged = 0;
+        for (size_t i = 1; i < dirty.size(); i++) {
+            // Close gaps cheaper to re-send than to pay another call for
+            if (dirty[i].begin <= dirty[merged].end + MERGE_GAP)
+                dirty[merged].end = std::max(dirty[merged].end, dirty[i].end);
+            else
+                dirty[++merged] = dirty[i];
+        }
+        dirty.resize(merged + 1);
+        for (const Range &range : dirty) {
+            glBufferSubData(GL_ARRAY_BUFFER, range.begin * sizeof(InstanceData),
+                            (range.end - range.begin) * sizeof(InstanceData), &instances[range.begin]);
+            countUpload(range.end - range.begin);
+        }
+        dirty.clear();
+    }
+
+    // Shift the attributes so instance 0 reads instance first, emulating a draw's baseInstance
+    // where the driver lacks it. setBaseInstance(0) restores them
+    void setBaseInstance(GLuint first) {
+        writePointers(attributeBuffer, attributeOffset + (GLintptr)(first * sizeof(InstanceData)));
+    }
+
+    void resetStats() {
+        stats = Stats();
+    }
+
+private:
+    struct Range {
+        size_t begin;
+        size_t end;
+    };
+    // Instances (~1.6 KB) between two dirty ranges that are uploaded rather than split the call
+    static const size_t MERGE_GAP = 16;
+
+    StreamBuffer *stream;
+    std::vector<InstanceData> instances;
+    std::vector<Range> dirty;
+    // Instances the GL buffer has storage for
+    size_t capacity = 0;
+    // Vertex array the attributes were attached to, and where they currently point
+    GLuint attached = 0;
+    GLuint attributeBuffer = 0;
+    GLintptr attributeOffset = -1;
+
+    void pointAttributes(GLuint buffer, GLintptr offset) {
+        writePointers(buffer, offset);
+        attributeBuffer = buffer;
+        attributeOffset = offset;
+    }
+    void writePointers(GLuint buffer, GLintptr offset) {
+        glState().bindVertexArray(attached);
+        glState().bindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (GLuint column = 0; column < 4; column++) {
+            GLuint location = INSTANCE_MODEL_LOCATION + column;
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offset + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+        for (GLuint column = 0; column < 3; column++) {
+            GLuint location = INSTANCE_NORMAL_MATRIX_LOCATION + column;
+            glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offset + offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3)));
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+    }
+
+    // All instances into this frame's stream region. False when the region is full, in which case
+    // the instances go through the buffer's own storage this frame
+    bool uploadStreamed() {
+        size_t bytes = instances.size() * sizeof(InstanceData);
+        StreamBuffer::Allocation allocation = stream->allocate(bytes, 4);
+        if (!allocation.data) {
+            if (attributeBuffer != ID) {
+                // The own storage has not tracked changes while streaming
+                markDirty(0, instances.size());
+                pointAttributes(ID, 0);
+            }
+            return false;
+        }
+        memcpy(allocation.data, instances.data(), bytes);
+        dirty.clear();
+        if (attributeBuffer != stream->ID || attributeOffset != allocation.offset)
+            pointAttributes(stream->ID, allocation.offset);
+        countUpload(instances.size());
+        return true;
+    }
+
+    void countUpload(size_t uploaded) {
+        stats.uploads++;
+        stats.bytes += uploaded * sizeof(InstanceData);
+    }
+    void clampDirty(size_t count) {
+        size_t kept = 0;
+        for (Range range : dirty) {
+            range.end = std::min(range.end, count);
+            if (range.begin < range.end)
+                dirty[kept++] = range;
+        }
+        dirty.resize(kept);
+    }
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef KTX_FILE_H
+#define KTX_FILE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Baked texture container laid out like KTX 2.0: the same 12-byte identifier, header fields and
+// level index, with levels addressed by byte offset. Files are written by texture_baker.cpp and read
+// in place through a memory mapping (KtxFile). Only what a 2D texture with a full mip chain needs
+// is kept: there is no data format descriptor, key/value data or supercompression, so
+// dfd/kvd/sgd are always empty and the format is named by its vkFormat alone.
+//
+//   KtxHeader                 80 bytes
+//   KtxLevel[levelCount]      24 bytes each, level 0 (full size) first
+//   level data                each level starting on a 16-byte boundary
+struct KtxHeader {
+    unsigned char identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+static_assert(sizeof(KtxHeader) == 80, "KTX2 header is 80 bytes");
+
+struct KtxLevel {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+static_assert(sizeof(KtxLevel) == 24, "KTX2 level index entries are three 64-bit values");
+
+// The Vulkan format numbers KTX 2.0 names formats by, for those the baker writes
+enum KtxFormat : uint32_t {
+    KTX_R8_UNORM = 9,
+    KTX_R8G8_UNORM = 16,
+    KTX_R8G8B8_UNORM = 23,
+    KTX_R8G8B8_SRGB = 29,
+    KTX_R8G8B8A8_UNORM = 37,
+    KTX_R8G8B8A8_SRGB = 43,
+    // Block compressed, see block_compression.h
+    KTX_BC1_RGB_UNORM = 131,
+    KTX_BC3_UNORM = 137,
+    KTX_BC7_UNORM = 145,
+};
+
+const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+const size_t KTX_LEVEL_ALIGNMENT = 16;
+
+inline uint32_t ktxLevelExtent(uint32_t extent, uint32_t level) {
+    return std::max<uint32_t>(extent >> level, 1);
+}
+
+// Write a container; levels[i] holds mip i, tightly packed texels or blocks
+inline bool writeKtxFile(const std::string &path, uint32_t vkFormat, uint32_t width, uint32_t height,
+                         const std::vector<std::vector<unsigned char>> &levels) {
+    KtxHeader header = {};
+    memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    header.vkFormat = vkFormat;
+    header.typeSize = 1;
+    header.pixelWidth = width;
+    header.pixelHeight = height;
+    header.faceCount = 1;
+    header.levelCount = (uint32_t)levels.size();
+
+    std::vector<KtxLevel> index(levels.size());
+    uint64_t offset = sizeof(KtxHeader) + sizeof(KtxLevel) * levels.size();
+    for (size_t level = 0; level < levels.size(); level++) {
+        offset = (offset + KTX_LEVEL_ALIGNMENT - 1) & ~(uint64_t)(KTX_LEVEL_ALIGNMENT - 1);
+        index[level].byteOffset = offset;
+        index[level].byteLength = index[level].uncompressedByteLength = levels[level].size();
+        offset += levels[level].size();
+    }
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cout << "ERROR::KTX::CANNOT_WRITE " << path << std::endl;
+        return false;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(index.data(), sizeof(KtxLevel), index.size(), file) == index.size();
+    size_t position = sizeof(KtxHeader) + sizeof(KtxLevel) * levels.size();
+    const unsigned char padding[KTX_LEVEL_ALIGNMENT] = {};
+    for (size_t level = 0; written && level < levels.size(); level++) {
+        size_t paddingSize = (size_t)index[level].byteOffset - position;
+        written = fwrite(padding, 1, paddingSize, file) == paddingSize &&
+                  fwrite(levels[level].data(), 1, levels[level].size(), file) == levels[level].size();
+        position = (size_t)index[level].byteOffset + levels[level].size();
+    }
+    written = fclose(file) == 0 && written;
+    if (!written)
+        std::cout << "ERROR::KTX::WRITE_FAILED " << path << std::endl;
+    return written;
+}
+
+// Read-only memory mapping of a container. Level data is used in place: nothing is copied or
+// decoded, and pages are only read in as a level is touched
+class KtxFile {
+public:
+    KtxFile() = default;
+    ~KtxFile() {
+        close();
+    }
+    KtxFile(const KtxFile&) = delete;
+    KtxFile &operator=(const KtxFile&) = delete;
+
+    // Map and validate a file, printing why it was rejected
+    bool open(const std::string &path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cout << "ERROR::KTX::CANNOT_OPEN " << path << std::endl;
+            return false;
+        }
+        struct stat status;
+        if (fstat(fd, &status) == 0 && status.st_size > 0) {
+            void *mapping = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                data = static_cast<const unsigned char*>(mapping);
+                size = (size_t)status.st_size;
+            }
+        }
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+        if (!data) {
+            std::cout << "ERROR::KTX::CANNOT_MAP " << path << std::endl;
+            return false;
+        }
+        if (!valid()) {
+            std::cout << "ERROR::KTX::INVALID_FILE " << path << std::endl;
+            close();
+            return false;
+        }
+        // Levels are read front to back once, for upload
+        madvise(const_cast<unsigned char*>(data), size, MADV_SEQUENTIAL);
+        return true;
+    }
+    void close() {
+        if (data)
+            munmap(const_cast<unsigned char*>(data), size);
+        data = nullptr;
+        size = 0;
+    }
+
+    const KtxHeader &header() const {
+        return *reinterpret_cast<const KtxHeader*>(data);
+    }
+    uint32_t levelCount() const {
+        return header().levelCount;
+    }
+    uint32_t width(uint32_t level = 0) const {
+        return ktxLevelExtent(header().pixelWidth, level);
+    }
+    uint32_t height(uint32_t level = 0) const {
+        return ktxLevelExtent(header().pixelHeight, level);
+    }
+    const unsigned char *levelData(uint32_t level) const {
+        return data + levels()[level].byteOffset;
+    }
+    size_t levelSize(uint32_t level) const {
+        return (size_t)levels()[level].byteLength;
+    }
+    size_t mappedBytes() const {
+        return size;
+    }
+
+private:
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+
+    const KtxLevel *levels() const {
+        return reinterpret_cast<const KtxLevel*>(data + sizeof(KtxHeader));
+    }
+
+    bool valid() const {
+        if (size < sizeof(KtxHeader) || memcmp(data, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0)
+            return false;
+        const KtxHeader &h = header();
+        if (h.pixelWidth == 0 || h.pixelHeight == 0 || h.levelCount == 0 || h.levelCount > 32 || h.supercompressionScheme != 0)
+            return false;
+        if (size < sizeof(KtxHeader) + sizeof(KtxLevel) * h.levelCount)
+            return false;
+        for (uint32_t level = 0; level < h.levelCount; level++) {
+            const KtxLevel &entry = levels()[level];
+            if (entry.byteOffset % KTX_LEVEL_ALIGNMENT != 0 || entry.byteOffset > size || entry.byteLength > size - entry.byteOffset)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef KTX_TEXTURE_H
+#define KTX_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <iostream>
+
+#include "gl_state.h"
+#include "gl_ext.h"
+#include "ktx_file.h"
+
+// GL upload parameters for a container format. Block compressed formats have blockBytes per 4x4
+// block instead of a format and type, and supported to ask whether the driver takes them
+struct KtxGLFormat {
+    GLenum internalFormat;
+    GLenum format;
+    GLenum type;
+    uint32_t texelBytes;
+    uint32_t blockBytes;
+    bool (*supported)();
+};
+
+inline bool ktxGLFormat(uint32_t vkFormat, KtxGLFormat &out) {
+    switch (vkFormat) {
+        case KTX_R8_UNORM:       out = { GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1, 0, nullptr }; return true;
+        case KTX_R8G8_UNORM:     out = { GL_RG8, GL_RG, GL_UNSIGNED_BYTE, 2, 0, nullptr }; return true;
+        case KTX_R8G8B8_UNORM:   out = { GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, 3, 0, nullptr }; return true;
+        case KTX_R8G8B8_SRGB:    out = { GL_SRGB8, GL_RGB, GL_UNSIGNED_BYTE, 3, 0, nullptr }; return true;
+        case KTX_R8G8B8A8_UNORM: out = { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, 0, nullptr }; return true;
+        case KTX_R8G8B8A8_SRGB:  out = { GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, 0, nullptr }; return true;
+        case KTX_BC1_RGB_UNORM:  out = { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_NONE, GL_NONE, 0, 8, glext::s3tcSupported }; return true;
+        case KTX_BC3_UNORM:      out = { GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_NONE, GL_NONE, 0, 16, glext::s3tcSupported }; return true;
+        case KTX_BC7_UNORM:      out = { GL_COMPRESSED_RGBA_BPTC_UNORM, GL_NONE, GL_NONE, 0, 16, glext::bptcSupported }; return true;
+        default:                 return false;
+    }
+}
+
+// Load a texture baked by texture_baker.cpp. The file is mapped and every level is specified
+// straight from the mapping, so there is no decode, no mip generation and no intermediate copy in
+// the process; once the driver has taken the data the mapping is dropped. Returns 0 on failure
+inline GLuint loadKtxTexture(const char *path) {
+    KtxFile file;
+    if (!file.open(path))
+        return 0;
+    KtxGLFormat format;
+    if (!ktxGLFormat(file.header().vkFormat, format)) {
+        std::cout << "ERROR::KTX::UNSUPPORTED_FORMAT " << file.header().vkFormat << " in " << path << std::endl;
+        return 0;
+    }
+    if (format.supported && !format.supported()) {
+        std::cout << "ERROR::KTX::COMPRESSION_NOT_SUPPORTED_BY_DRIVER " << file.header().vkFormat << " in " << path << std::endl;
+        return 0;
+    }
+    for (uint32_t level = 0; level < file.levelCount(); level++) {
+        size_t expected = format.blockBytes ? (size_t)((file.width(level) + 3) / 4) * ((file.height(level) + 3) / 4) * format.blockBytes
+                                            : (size_t)file.width(level) * file.height(level) * format.texelBytes;
+        if (file.levelSize(level) < expected) {
+            std::cout << "ERROR::KTX::TRUNCATED_LEVEL " << level << " in " << path << std::endl;
+            return 0;
+        }
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glState().bindTexture(0, texture);
+    // Client memory, not a pixel buffer, and rows tightly packed
+    glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (uint32_t level = 0; level < file.levelCount(); level++) {
+        if (format.blockBytes)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, format.internalFormat, file.width(level), file.height(level), 0,
+                                   (GLsizei)file.levelSize(level), file.levelData(level));
+        else
+            glTexImage2D(GL_TEXTURE_2D, level, format.internalFormat, file.width(level), file.height(level), 0,
+                         format.format, format.type, file.levelData(level));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, file.levelCount() - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, file.levelCount() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+}
+
+#endif
@@ -1,16 +1,40 @@
 #include <iostream>
 #include <cmath>
+#include <string>
+#include <chrono>
+#include <algorithm>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "gl_ext.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+// Headers below include stb_image.h again for the declarations only
+#undef STB_IMAGE_IMPLEMENTATION
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.h"
+#include "shader_variants.h"
 #include "camera.h"
+#include "uniform_buffer.h"
+#include "file_watcher.h"
+#include "normal_matrix.h"
+#include "gl_state.h"
+#include "stream_buffer.h"
+#include "instance_buffer.h"
+#include "mesh.h"
+#include "mesh_pool.h"
+#include "render_queue.h"
+#include "command_buffer.h"
+#include "worker_pool.h"
+#include "culling.h"
+#include "bvh.h"
+#include "occlusion_culling.h"
+#include "texture_loader.h"
+#include "texture_cache.h"
+#include "benchmark.h"
 
 const GLint WIDTH = 800, HEIGHT = 600;
 
@@ -30,8 +54,27 @@ float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 float currentFrame;
 
-int main() {
+int main(int argc, char *argv[]) {
+    auto launchTime = std::chrono::high_resolution_clock::now();
+    // Optional microbenchmark to run instead of the render loop
+    std::string benchmark = (argc > 2 && std::string(argv[1]) == "--bench") ? argv[2] : "";
+    // Hardware occlusion culling behind the frustum culling, see occlusion_culling.h
+    bool occlusionCulling = false;
+    // Textures are block compressed on load where the driver takes BCn, unless this is given
+    bool uncompressedTextures = false;
+    for (int i = 1; i < argc; i++) {
+        occlusionCulling = occlusionCulling || std::string(argv[i]) == "--occlusion";
+        uncompressedTextures = uncompressedTextures || std::string(argv[i]) == "--uncompressed-textures";
+    }
+
     glfwInit();
+    // GL objects below release their names in their destructors, which need a current context.
+    // Declared first so it is destroyed last: glfwTerminate() runs once everything else is gone
+    struct GLFWTerminator {
+        ~GLFWTerminator() {
+            glfwTerminate();
+        }
+    } glfwTerminator;
 
     // Set OpenGL window to version 3.3
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -49,7 +92,6 @@ int main() {
 
     if (window == NULL) {
         std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
         return -1;
     }
 
@@ -60,12 +102,35 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    glext::load((GLADloadproc)glfwGetProcAddress);
 
     glViewport(0, 0, screenWidth, screenHeight);
 
-    // Build and compile shaders
-    Shader shader("shader.vs", "shader.fs");
-    Shader lampShader("shader.vs", "lamp.fs");
+    // Submit all shader builds before checking any of them so the driver can compile in parallel,
+    // reusing linked binaries from earlier runs where the driver allows
+    auto shaderStart = std::chrono::high_resolution_clock::now();
+    Shader::setBlockBinding("FrameData", FRAME_DATA_BINDING);
+    Shader::setBinaryCacheDirectory("shader_cache");
+    // Vertex storage for the cube mesh. Quantized vertices need the matching shader permutations
+    const VertexFormat cubeFormat = VERTEX_QUANTIZED;
+    const bool quantized = cubeFormat == VERTEX_QUANTIZED;
+    // The boxes are drawn in one instanced call with the specular-mapped permutation of the lit shader
+    ShaderVariants litShaders("shader.vs", "shader.fs", LIT_SHADER_FEATURES);
+    const uint32_t boxFeatures = FEATURE_SPECULAR_MAP | FEATURE_INSTANCED | (quantized ? (uint32_t)FEATURE_QUANTIZED : 0u);
+    litShaders.prewarm({ boxFeatures });
+    Shader &shader = litShaders.get(boxFeatures);
+    // Instanced like the boxes, so every draw in the frame reads its transform the same way
+    std::vector<std::string> lampDefines = { "INSTANCED" };
+    if (quantized)
+        lampDefines.push_back("QUANTIZED_VERTICES");
+    Shader lampShader("shader.vs", "lamp.fs", Shader::Deferred, lampDefines);
+    // The lamp program doubles as the cube fallback while the lit program is still linking
+    lampShader.finish();
+    // Proxy boxes for occlusion queries, which are skipped until it has linked
+    Shader occlusionShader("occlusion.vs", "occlusion.fs", Shader::Deferred);
+    std::chrono::duration<double, std::milli> shaderTime = std::chrono::high_resolution_clock::now() - shaderStart;
+    std::cout << "Shaders submitted in " << shaderTime.count() << " ms (program cache: "
+              << Shader::binaryCacheStats().hits << " hits, " << Shader::binaryCacheStats().misses << " misses)" << std::endl;
 
     float vertices[] = {
         // positions          // normals           // texture coords
@@ -127,132 +192,358 @@ int main() {
         glm::vec3(3.3f,  1.0f, -1.5f)
     };
 
-    unsigned int VBO, VAO, lightCubeVAO;
-    glGenVertexArrays(1, &VAO);
-    glGenVertexArrays(1, &lightCubeVAO);
-    glGenBuffers(1, &VBO);
-
-    glBindVertexArray(VAO);
-    
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    // Weld the cube's 36 corners down to its unique vertices and draw it indexed
+    const size_t cubeVertexCount = sizeof(vertices) / (8 * sizeof(float));
+    Mesh cubeMesh = buildMesh("cube", reinterpret_cast<const Vertex*>(vertices), cubeVertexCount);
+    if (quantized)
+        reportQuantizationError("cube", cubeMesh.vertices);
+
+    // Every mesh lives in one pool drawn through indirect commands
+    MeshPool meshPool(cubeFormat);
+    MeshPool::MeshId cubeId = meshPool.add(cubeMesh);
+    meshPool.upload();
+    // Quantized positions decode against the given bounds; pool meshes carry theirs in the model
+    // matrix, so programs drawing from the pool decode with the identity
+    auto setPositionBounds = [&](Shader &program, const MeshBounds &bounds) {
+        program.use();
+        program.setVec3("positionCenter", bounds.center);
+        program.setVec3("positionExtent", bounds.extent);
+    };
+    setPositionBounds(lampShader, MeshBounds());
 
-    // Configure vertex position attributes
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    // Ring buffer for everything written each frame, three frames deep
+    StreamBuffer frameStream(64 * 1024, 3);
 
-    // Configure vertex surface normal attributes
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    
-    // Configure vertex texture coord attributes
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    // Scene objects: the 12 boxes, then the lamp
+    const unsigned int sceneObjects = 13;
+    const unsigned int lampObject = 12;
 
-    glBindVertexArray(lightCubeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    // Configure vertex position attributes
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    // Per-draw model and normal matrices, read once per instance and streamed every frame
+    InstanceBuffer sceneInstances(&frameStream);
+    sceneInstances.resize(sceneObjects);
+    sceneInstances.attach(meshPool.VAO);
 
     glm::vec3 lightPos(1.2f, 4.0f, 4.0f);
-    
-    // Set light intensities
-    shader.use();
-    shader.setVec3("light.ambient",  0.2f, 0.2f, 0.2f);
-    shader.setVec3("light.diffuse",  0.5f, 0.5f, 0.5f);
-    shader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
 
-    // Set projection matrix
-    glm::mat4 projection = glm::mat4(1.0f);
-    projection = glm::perspective(glm::radians(45.0f), (float)WIDTH / (float)HEIGHT, 0.1f, 100.0f);
-    shader.setMat4("projection", projection);
+    if (!benchmark.empty()) {
+        // The per-draw uniform paths are measured on the non-instanced permutation
+        Shader &perCubeShader = litShaders.get(boxFeatures & ~FEATURE_INSTANCED);
+        Shader::finishAll({ &shader, &perCubeShader });
+        // Single-mesh benchmarks draw the cube from its own buffers
+        MeshBuffer cubeBuffer(cubeMesh, cubeFormat);
+        GLuint cubeVAO;
+        glGenVertexArrays(1, &cubeVAO);
+        cubeBuffer.attach(cubeVAO);
+        setPositionBounds(shader, cubeBuffer.bounds);
+        setPositionBounds(perCubeShader, cubeBuffer.bounds);
+        if (benchmark == "uniforms")
+            benchUniformSetters(perCubeShader);
+        else if (benchmark == "instancing")
+            benchInstancing(perCubeShader, shader, cubeVAO, cubeBuffer);
+        else if (benchmark == "multidraw") {
+            Shader &floatShader = litShaders.get(FEATURE_SPECULAR_MAP);
+            Shader &floatInstancedShader = litShaders.get(FEATURE_SPECULAR_MAP | FEATURE_INSTANCED);
+            Shader::finishAll({ &floatShader, &floatInstancedShader });
+            benchMultiDraw(floatShader, floatInstancedShader);
+        }
+        else if (benchmark == "vertexformat") {
+            Shader &floatShader = litShaders.get(FEATURE_SPECULAR_MAP);
+            Shader &quantizedShader = litShaders.get(FEATURE_SPECULAR_MAP | FEATURE_QUANTIZED);
+            Shader::finishAll({ &floatShader, &quantizedShader });
+            benchVertexFormats(floatShader, quantizedShader);
+        }
+        else if (benchmark == "culling")
+            benchCulling();
+        else if (benchmark == "bvh")
+            benchBVH();
+        else if (benchmark == "textures")
+            benchTextureLoading(loadTexture);
+        else if (benchmark == "load-png" || benchmark == "load-ktx")
+            benchTextureStartup(benchmark == "load-ktx", loadTexture);
+        else if (benchmark == "compression")
+            benchBlockCompression();
+        else if (benchmark == "mipmaps")
+            benchMipmapGeneration();
+        else
+            std::cout << "Unknown benchmark: " << benchmark << std::endl;
+        // cubeBuffer is released on return, before the terminate guard
+        glState().deleteVertexArray(cubeVAO);
+        return 0;
+    }
+
+    // Camera data shared by every program, uploaded once per frame
+    UniformBuffer<FrameData> frameBuffer(FRAME_DATA_BINDING);
+    FrameData frameData;
 
     // Enable wireframe mode
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
     // Enable z-buffer
-    glEnable(GL_DEPTH_TEST);
+    glState().setEnabled(GL_DEPTH_TEST, true);
     
     // Enable mouse input
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     
-    // Enable textures
-    GLuint diffuseMap = loadTexture("crate.png");
-    GLuint specularMap = loadTexture("crate_specular.png");
-    
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuseMap);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, specularMap);
-    
-    shader.setInt("material.diffuse", 0);
-    shader.setInt("material.specular", 1);
+    // Enable textures. They decode and upload in the background, and the material samples a
+    // placeholder until each is resident. Textures are shared through the cache
+    TextureLoader textureLoader;
+    textureLoader.compress = glext::s3tcSupported() && !uncompressedTextures;
+    textureLoader.bc7 = glext::bptcSupported();
+    // Mips are filtered in linear light on the decode threads rather than by glGenerateMipmap
+    textureLoader.cpuMipmaps = true;
+    TextureCache textureCache(textureLoader);
+    TextureCache::Handle diffuseMap = textureCache.acquire("crate.png");
+    TextureCache::Handle specularMap = textureCache.acquire("crate_specular.png");
+    Material boxMaterial;
+    bool firstFrame = true;
+    bool texturesReported = false;
+
+    // Draws are queued each frame and issued in state/depth order
+    RenderQueue renderQueue;
+
+    // Scene preparation runs in slices on the worker pool. Each slice records its draws into its own
+    // command buffer, and this thread replays the buffers in slice order
+    WorkerPool &workers = WorkerPool::instance();
+    std::vector<CommandBuffer> sceneCommands(workers.threadCount());
+    CommandReplay commandReplay(&sceneInstances);
+    // Objects per slice below which another thread costs more than it saves
+    const size_t sliceObjects = 256;
+
+    // One-time setup of the lit program, run on the first frame it reports ready
+    bool litShaderReady = false;
+    auto configureLitShader = [&]() {
+        std::chrono::duration<double, std::milli> readyTime = std::chrono::high_resolution_clock::now() - shaderStart;
+        std::cout << "Lit shader ready after " << readyTime.count() << " ms" << std::endl;
+
+        setPositionBounds(shader, MeshBounds());
+
+        // Set light intensities
+        shader.setVec3("light[0].ambient",  0.2f, 0.2f, 0.2f);
+        shader.setVec3("light[0].diffuse",  0.5f, 0.5f, 0.5f);
+        shader.setVec3("light[0].specular", 1.0f, 1.0f, 1.0f);
+
+        shader.setInt("material.diffuse", 0);
+        shader.setInt("material.specular", 1);
+        shader.setFloat("material.shininess", 64.0f);
+
+        litShaderReady = true;
+    };
+
+    // Hot reload: rebuild programs whose sources change on disk while the old ones keep drawing
+    FileWatcher shaderWatcher;
+    shaderWatcher.watch("shader.vs");
+    shaderWatcher.watch("shader.fs");
+    shaderWatcher.watch("lamp.fs");
+    shaderWatcher.watch("frame_data.glsl");
+    shaderWatcher.watch("lighting.glsl");
+    // Worst frame time seen while a reload is in flight, checked against a 60 Hz budget
+    const float frameBudget = 1.0f / 60.0f;
+    float reloadWorstFrame = 0.0f;
+    bool reloadInFlight = false;
+    bool reloadFinished = false;
     
+    // Per-frame scene transforms
+    glm::mat4 sceneModels[sceneObjects];
+    glm::mat3 sceneNormalMatrices[sceneObjects];
+    TransformKind sceneTransformKinds[sceneObjects];
+    float sceneDepths[sceneObjects];
+    // World bounds of every object, a BVH over them refit as they move, and the indices of those in view
+    std::vector<MeshBounds> sceneBounds(sceneObjects);
+    BVH sceneBVH;
+    std::vector<uint32_t> sceneVisible(sceneObjects);
+    size_t visibleObjects = 0;
+    // Objects in view are queried against the frame's depth and skipped while their boxes stay hidden
+    OcclusionCuller occlusionCuller(&occlusionShader);
+    occlusionCuller.resize(sceneObjects);
+
+    // Profiling counters are printed every few seconds
+    const float statsInterval = 5.0f;
+    float statsTimer = 0.0f;
+
     // Render loop
     while (!glfwWindowShouldClose(window)) {
         // Per-frame time logic
         currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+
+        // deltaTime covers the previous frame, which includes any reload work it did
+        if (reloadInFlight)
+            reloadWorstFrame = std::max(reloadWorstFrame, deltaTime);
+        if (reloadFinished) {
+            std::cout << "Shader reload worst frame: " << reloadWorstFrame * 1000.0f << " ms (budget "
+                      << frameBudget * 1000.0f << " ms)" << (reloadWorstFrame > frameBudget ? " OVER BUDGET" : "") << std::endl;
+            reloadInFlight = reloadFinished = false;
+            reloadWorstFrame = 0.0f;
+        }
+        for (const std::string &path : shaderWatcher.poll()) {
+            if (litShaders.dependsOn(path))
+                litShaders.reload();
+            if (lampShader.dependsOn(path))
+                lampShader.reload();
+            reloadInFlight = true;
+        }
+        Shader::ReloadStatus reloadStatus[] = { litShaders.pollReload(), lampShader.pollReload() };
+        bool reloading = false;
+        for (Shader::ReloadStatus status : reloadStatus) {
+            if (status == Shader::ReloadFailed)
+                std::cout << "Shader reload failed, keeping the previous program" << std::endl;
+            reloading = reloading || status == Shader::Reloading;
+        }
+        if (reloadInFlight && !reloading)
+            reloadFinished = true;
         
         processInput(window);
         
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Activate shader
-        shader.use();
-
-        // Pass projection matrix to shader
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)WIDTH / (float)HEIGHT, 0.1f, 100.0f);
-        shader.setMat4("projection", projection);
+        // Per-frame data goes through the ring until flush() below
+        frameStream.beginFrame();
+
+        // Projection, camera/view transformation and camera position for all programs
+        frameData.projection = glm::perspective(glm::radians(camera.Zoom), (float)WIDTH / (float)HEIGHT, 0.1f, 100.0f);
+        frameData.view = camera.GetViewMatrix();
+        frameData.viewPos = glm::vec4(camera.Position, 1.0f);
+        frameBuffer.update(frameData, frameStream);
+
+        if (!litShaderReady && shader.isReady())
+            configureLitShader();
+
+        // Upload this frame's share of decoded textures and pick up the ones that became resident
+        textureLoader.upload();
+        boxMaterial.diffuse = diffuseMap.texture();
+        boxMaterial.specular = specularMap.texture();
+        if (textureLoader.idle() && !texturesReported) {
+            std::chrono::duration<double, std::milli> sinceLaunch = std::chrono::high_resolution_clock::now() - launchTime;
+            std::cout << "Textures loaded: " << textureLoader.stats.resident << " resident, " << textureLoader.stats.failed
+                      << " failed, " << textureLoader.stats.uploadedBytes << " bytes over " << textureLoader.stats.uploadFrames
+                      << " frames in " << textureLoader.stats.loadMs << " ms (" << sinceLaunch.count() << " ms after launch)" << std::endl;
+            texturesReported = true;
+        }
 
-        // Camera/view transformation
-        glm::mat4 view = camera.GetViewMatrix();
-        shader.setMat4("view", view);
-        shader.setVec3("viewPos", camera.Position);
-        
-        // Render boxes
-        for (unsigned int i = 0; i < 12; i++) {
-            // Set world coordinates of object
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 30.0f;
-            if (i == 0) { angle = 40.0f; }
-//                model = glm::rotate(model, (float)glfwGetTime() * glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            shader.setMat4("model", model);
-//            shader.setVec3("material.specular", 0.5f, 0.5f, 0.5f);
-            shader.setFloat("material.shininess", 64.0f);
-
-            glBindVertexArray(VAO);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        // Set world coordinates of the boxes and the lamp, their normal matrices, bounds and view depths
+        workers.parallelFor(sceneObjects, workers.chunksFor(sceneObjects, sliceObjects), [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                if (i == lampObject) {
+                    sceneModels[i] = glm::scale(glm::translate(glm::mat4(1.0f), lightPos), glm::vec3(0.2f));
+                    sceneTransformKinds[i] = TRANSFORM_UNIFORM_SCALE;
+                }
+                else {
+                    glm::mat4 model = glm::mat4(1.0f);
+                    model = glm::translate(model, cubePositions[i]);
+                    float angle = 30.0f;
+                    if (i == 0) { angle = 40.0f; }
+//                        model = glm::rotate(model, (float)glfwGetTime() * glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+                    sceneModels[i] = model;
+                    // Translation and rotation only
+                    sceneTransformKinds[i] = TRANSFORM_UNIFORM_SCALE;
+                }
+                sceneBounds[i] = transformBounds(meshPool.mesh(cubeId).bounds, sceneModels[i]);
+                sceneDepths[i] = -(frameData.view * sceneModels[i][3]).z;
+            }
+            computeNormalMatrices(sceneModels + begin, sceneTransformKinds + begin, sceneNormalMatrices + begin, end - begin);
+        });
+
+        // Queue every object in view. The boxes use the lamp program until the lit program has linked
+        sceneBVH.update(sceneBounds);
+        visibleObjects = sceneBVH.cullFrustum(camera.GetFrustum(frameData.projection), sceneVisible.data());
+        if (occlusionCulling)
+            occlusionCuller.beginFrame();
+        Shader *boxProgram = litShaderReady ? &shader : &lampShader;
+        renderQueue.clear();
+        for (size_t visible = 0; visible < visibleObjects; visible++) {
+            unsigned int i = sceneVisible[visible];
+            RenderQueue::Draw draw = { boxProgram, &boxMaterial, &meshPool, cubeId, i };
+            if (i == lampObject)
+                draw = { &lampShader, nullptr, &meshPool, cubeId, i };
+            if (occlusionCulling) {
+                OcclusionCuller::Visibility visibility = occlusionCuller.classify(i);
+                if (visibility == OcclusionCuller::OCCLUSION_OCCLUDED)
+                    continue;
+                if (visibility == OcclusionCuller::OCCLUSION_CONDITIONAL)
+                    draw.condition = occlusionCuller.query(i);
+            }
+            renderQueue.add(draw, sceneDepths[i]);
         }
-        
-        lampShader.use();
-        
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, lightPos);
-        model = glm::scale(model, glm::vec3(0.2f));
-        lampShader.setMat4("model", model);
-        lampShader.setMat4("projection", projection);
-        lampShader.setMat4("view", view);
-        
-        glBindVertexArray(lightCubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        renderQueue.sort();
+
+        // Record the sorted draws slice by slice, each slice writing its own instances. Instances go
+        // in submission order, so runs of one mesh and state draw as one command
+        size_t drawSlices = workers.chunksFor(renderQueue.size(), sliceObjects);
+        InstanceData *instanceData = sceneInstances.data();
+        workers.parallelFor(renderQueue.size(), drawSlices, [&](size_t begin, size_t end, size_t slice) {
+            CommandBuffer &commands = sceneCommands[slice];
+            commands.reset();
+            renderQueue.record(commands, begin, end);
+            for (size_t slot = begin; slot < end; slot++) {
+                const RenderQueue::Draw &draw = renderQueue.sorted(slot);
+                instanceData[slot].model = meshPool.instanceModel(draw.mesh, sceneModels[draw.object]);
+                instanceData[slot].normalMatrix = sceneNormalMatrices[draw.object];
+            }
+        });
+        sceneInstances.markDirty(0, renderQueue.size());
+        sceneInstances.upload();
+        frameStream.flush();
+
+        // GL calls stay on this thread
+        for (size_t slice = 0; slice < drawSlices; slice++)
+            commandReplay.execute(sceneCommands[slice]);
+        commandReplay.finish();
+
+        // Query the objects in view against the depth just drawn, for use on later frames
+        if (occlusionCulling)
+            occlusionCuller.issueQueries(sceneBounds.data(), sceneVisible.data(), visibleObjects, camera.Position);
+
+        // Fence this frame's region after its last draw
+        frameStream.endFrame();
+
+        statsTimer += deltaTime;
+        if (statsTimer >= statsInterval) {
+            Shader::UploadStats uploads = Shader::uploadStats();
+            GLState::Stats state = glState().stats;
+            std::cout << "Uniform uploads per frame: " << uploads.issued << " issued, " << uploads.skipped << " skipped; "
+                      << "GL state changes: " << state.issued << " issued, " << state.elided << " elided; "
+                      << "instance uploads: " << sceneInstances.stats.uploads << " (" << sceneInstances.stats.bytes << " bytes); "
+                      << "stream stalls: " << frameStream.stats.stalls << " (" << frameStream.stats.stallMs << " ms) in "
+                      << frameStream.stats.frames << " frames, " << frameStream.stats.overflows << " overflows; "
+                      << "draws: " << meshPool.stats.commands << " in " << meshPool.stats.calls << " calls; "
+                      << "visible objects: " << visibleObjects << " of " << sceneObjects << "; "
+                      << "queue state changes: " << renderQueue.stats.unsortedChanges << " unsorted, "
+                      << renderQueue.stats.sortedChanges << " sorted; "
+                      << "recorded commands: " << commandReplay.stats.commands << " (" << commandReplay.stats.bytes
+                      << " bytes) in " << commandReplay.stats.buffers << " buffers; "
+                      << "texture cache: " << textureCache.stats.pathHits << " hits, " << textureCache.stats.misses << " misses ("
+                      << textureCache.stats.contentHits << " same pixels), " << textureCache.textureCount() << " textures, "
+                      << textureCache.residentBytes() << " bytes resident";
+            if (occlusionCulling) {
+                OcclusionCuller::Stats occlusion = occlusionCuller.stats;
+                std::cout << "; occlusion culled: " << occlusion.occluded << " of " << occlusion.tested << " in view, "
+                          << occlusion.conditional << " conditional, " << occlusion.queries << " queries";
+            }
+            std::cout << std::endl;
+            statsTimer = 0.0f;
+        }
+        Shader::resetUploadStats();
+        glState().resetStats();
+        sceneInstances.resetStats();
+        meshPool.resetStats();
+        commandReplay.resetStats();
+        occlusionCuller.resetStats();
 
         // Use double buffer
         // Only swap old frame with new when it is completed
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (firstFrame) {
+            std::chrono::duration<double, std::milli> firstFrameTime = std::chrono::high_resolution_clock::now() - launchTime;
+            std::cout << "First frame after " << firstFrameTime.count() << " ms (" << textureLoader.stats.resident << " of "
+                      << textureLoader.stats.requested << " textures resident)" << std::endl;
+            firstFrame = false;
+        }
     }
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
 
-    glfwTerminate();
     return 0;
 }
 
@@ -305,7 +596,7 @@ GLuint loadTexture(char const * path)
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        glState().bindTexture(0, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -0,0 +1,313 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "hash.h"
+#include "gl_state.h"
+#include "vertex_format.h"
+
+// Full-precision interleaved vertex: attribute locations 0, 1 and 2 in shader.vs
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoords;
+};
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "vertices are 8 tightly packed floats");
+
+// Indexed triangle list
+struct Mesh {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// Post-transform cache behaviour of an index order, simulated with a FIFO cache.
+// ACMR is vertices transformed per triangle (0.5 is ideal for large grids, 3 is no reuse at all),
+// ATVR is vertices transformed per unique vertex (1 is ideal)
+struct VertexCacheStats {
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+// Size of the simulated cache, on the small side of what GPUs have so the numbers are not flattering
+const int VERTEX_CACHE_SIMULATED_SIZE = 16;
+
+inline VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount,
+                                           int cacheSize = VERTEX_CACHE_SIMULATED_SIZE) {
+    VertexCacheStats stats;
+    if (indices.empty() || vertexCount == 0)
+        return stats;
+    // Time each vertex entered the cache; it is still cached while fewer than cacheSize misses followed
+    std::vector<long> entered(vertexCount, -1);
+    long misses = 0;
+    for (uint32_t index : indices) {
+        if (entered[index] < 0 || misses - entered[index] >= cacheSize)
+            entered[index] = misses++;
+    }
+    stats.acmr = (float)misses / (float)(indices.size() / 3);
+    stats.atvr = (float)misses / (float)vertexCount;
+    return stats;
+}
+
+// Merge bit-identical vertices, turning an unindexed triangle list into an indexed one
+inline Mesh weldVertices(const Vertex *vertices, size_t count) {
+    Mesh mesh;
+    mesh.indices.reserve(count);
+    // Open addressing over the unique vertices, sized to a power of two at most half full
+    size_t buckets = 1;
+    while (buckets < count * 2)
+        buckets <<= 1;
+    std::vector<int32_t> table(buckets, -1);
+    for (size_t i = 0; i < count; i++) {
+        size_t bucket = hashBytes(&vertices[i], sizeof(Vertex)) & (buckets - 1);
+        while (table[bucket] >= 0 && memcmp(&mesh.vertices[table[bucket]], &vertices[i], sizeof(Vertex)) != 0)
+            bucket = (bucket + 1) & (buckets - 1);
+        if (table[bucket] < 0) {
+            table[bucket] = (int32_t)mesh.vertices.size();
+            mesh.vertices.push_back(vertices[i]);
+        }
+        mesh.indices.push_back((uint32_t)table[bucket]);
+    }
+    return mesh;
+}
+
+// ----------------------------------------------------------------------------
+// Reorder triangles for post-transform cache hits (Tom Forsyth, "Linear-Speed Vertex Cache
+// Optimisation"). Greedily emits the triangle whose vertices score best: recently used vertices
+// score high so their neighbours follow, and vertices with few triangles left get a boost so
+// they are finished off instead of being left stranded
+inline void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount) {
+    const int cacheSize = 32;
+    const float cacheDecayPower = 1.5f;
+    const float lastTriangleScore = 0.75f;
+    const float valenceBoostScale = 2.0f;
+    const float valenceBoostPower = 0.5f;
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    auto vertexScore = [&](int cachePosition, int remaining) {
+        if (remaining == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+                // The last triangle's vertices score a fixed amount so it is not simply repeated
+                score = lastTriangleScore;
+            }
+            else {
+                float scaler = 1.0f / (cacheSize - 3);
+                score = std::pow(1.0f - (cachePosition - 3) * scaler, cacheDecayPower);
+            }
+        }
+        return score + valenceBoostScale * std::pow((float)remaining, -valenceBoostPower);
+    };
+
+    // Triangles using each vertex, as offsets into one array
+    std::vector<uint32_t> triangleStart(vertexCount + 1, 0);
+    for (uint32_t index : indices)
+        triangleStart[index + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        triangleStart[v + 1] += triangleStart[v];
+    std::vector<uint32_t> vertexTriangles(indices.size());
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t v = indices[t * 3 + corner];
+            vertexTriangles[triangleStart[v] + remaining[v]++] = (uint32_t)t;
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(-1, remaining[v]);
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    // Three extra slots hold vertices just pushed out by the newest triangle
+    std::vector<uint32_t> cache, nextCache;
+    cache.reserve(cacheSize + 3);
+    nextCache.reserve(cacheSize + 3);
+    size_t scanCursor = 0;
+    long best = 0;
+    for (size_t t = 1; t < triangleCount; t++) {
+        if (triangleScore[t] > triangleScore[best])
+            best = (long)t;
+    }
+
+    while (best >= 0) {
+        emitted[best] = true;
+        const uint32_t *triangle = &indices[best * 3];
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t v = triangle[corner];
+            output.push_back(v);
+            // Drop the triangle from the vertex's list of remaining triangles
+            uint32_t *begin = &vertexTriangles[triangleStart[v]];
+            uint32_t *end = begin + remaining[v];
+            for (uint32_t *it = begin; it != end; it++) {
+                if (*it == (uint32_t)best) {
+                    *it = *(end - 1);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // The emitted triangle's vertices move to the front of the LRU cache
+        nextCache.assign(triangle, triangle + 3);
+        for (uint32_t v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                nextCache.push_back(v);
+        }
+        for (size_t i = 0; i < nextCache.size(); i++) {
+            uint32_t v = nextCache[i];
+            cachePosition[v] = i < (size_t)cacheSize ? (int)i : -1;
+            score[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+        if (nextCache.size() > (size_t)cacheSize)
+            nextCache.resize(cacheSize);
+        cache.swap(nextCache);
+
+        // Only triangles touching the cache changed score, so the next pick comes from them
+        best = -1;
+        float bestScore = -1.0f;
+        for (uint32_t v : cache) {
+            for (uint32_t i = 0; i < remaining[v]; i++) {
+                uint32_t t = vertexTriangles[triangleStart[v] + i];
+                triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+        // Nothing left around the cache: continue with the next triangle not yet emitted
+        if (best < 0) {
+            while (scanCursor < triangleCount && emitted[scanCursor])
+                scanCursor++;
+            if (scanCursor < triangleCount)
+                best = (long)scanCursor;
+        }
+    }
+    indices.swap(output);
+}
+
+// Renumber vertices in the order the index buffer first uses them, so vertex fetches walk memory
+// forwards. Vertices no index uses are dropped
+inline void optimizeVertexFetch(Mesh &mesh) {
+    std::vector<int32_t> remap(mesh.vertices.size(), -1);
+    std::vector<Vertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for (uint32_t &index : mesh.indices) {
+        if (remap[index] < 0) {
+            remap[index] = (int32_t)vertices.size();
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = (uint32_t)remap[index];
+    }
+    mesh.vertices.swap(vertices);
+}
+
+// Full mesh-building stage for an unindexed triangle list: weld, reorder triangles for the vertex
+// cache, then vertices for fetch order. Prints the cache statistics of each step under name
+inline Mesh buildMesh(const char *name, const Vertex *vertices, size_t count) {
+    std::vector<uint32_t> unindexed(count);
+    for (size_t i = 0; i < count; i++)
+        unindexed[i] = (uint32_t)i;
+    VertexCacheStats original = analyzeVertexCache(unindexed, count);
+
+    Mesh mesh = weldVertices(vertices, count);
+    VertexCacheStats welded = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    optimizeVertexCache(mesh.indices, mesh.vertices.size());
+    optimizeVertexFetch(mesh);
+    VertexCacheStats optimized = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "Mesh " << name << ": " << count << " -> " << mesh.vertices.size() << " vertices, "
+              << mesh.indices.size() / 3 << " triangles; ACMR/ATVR unindexed " << original.acmr << "/" << original.atvr
+              << ", welded " << welded.acmr << "/" << welded.atvr
+              << ", optimized " << optimized.acmr << "/" << optimized.atvr << std::defaultfloat << std::endl;
+    return mesh;
+}
+
+// A mesh in GL buffers, with vertices in either format. Indices are stored as 16-bit whenever every
+// vertex is addressable with them
+class MeshBuffer {
+public:
+    unsigned int VBO, EBO;
+    VertexFormat format;
+    // Dequantization box for VERTEX_QUANTIZED, set as positionCenter/positionExtent in shader.vs
+    MeshBounds bounds;
+    size_t vertexBytes;
+    GLenum indexType;
+    GLsizei indexCount;
+
+    explicit MeshBuffer(const Mesh &mesh, VertexFormat vertexFormat = VERTEX_FLOAT)
+        : format(vertexFormat), indexCount((GLsizei)mesh.indices.size()) {
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (format == VERTEX_QUANTIZED) {
+            bounds = meshBounds(mesh.vertices);
+            std::vector<QuantizedVertex> quantized = quantizeVertices(mesh.vertices, bounds);
+            vertexBytes = quantized.size() * sizeof(QuantizedVertex);
+            glBufferData(GL_ARRAY_BUFFER, vertexBytes, quantized.data(), GL_STATIC_DRAW);
+        }
+        else {
+            vertexBytes = mesh.vertices.size() * sizeof(Vertex);
+            glBufferData(GL_ARRAY_BUFFER, vertexBytes, mesh.vertices.data(), GL_STATIC_DRAW);
+        }
+
+        // The element buffer binding is VAO state, so upload through the generic copy target
+        // instead of disturbing whichever VAO is bound
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        if (mesh.vertices.size() <= 0x10000) {
+            indexType = GL_UNSIGNED_SHORT;
+            std::vector<uint16_t> shortIndices(mesh.indices.begin(), mesh.indices.end());
+            glBufferData(GL_COPY_WRITE_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+        }
+        else {
+            indexType = GL_UNSIGNED_INT;
+            glBufferData(GL_COPY_WRITE_BUFFER, mesh.indices.size() * sizeof(uint32_t), mesh.indices.data(), GL_STATIC_DRAW);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    ~MeshBuffer() {
+        glState().deleteBuffer(VBO);
+        glState().deleteBuffer(EBO);
+    }
+    MeshBuffer(const MeshBuffer&) = delete;
+    MeshBuffer &operator=(const MeshBuffer&) = delete;
+
+    // Point a vertex array's per-vertex attributes and element buffer at this mesh
+    void attach(GLuint vertexArray) {
+        glState().bindVertexArray(vertexArray);
+        glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        setVertexAttributes(format);
+    }
+
+    // Draw with a vertex array this mesh is attached to already bound
+    void draw() const {
+        glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+    }
+    void drawInstanced(GLsizei instances) const {
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, 0, instances);
+    }
+};
+
+#endif
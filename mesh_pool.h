@@ -0,0 +1,215 @@
+#ifndef MESH_POOL_H
+#define MESH_POOL_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "gl_ext.h"
+#include "gl_state.h"
+#include "mesh.h"
+#include "vertex_format.h"
+#include "instance_buffer.h"
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "indirect commands are five tightly packed ints");
+
+// Every mesh packed into one vertex buffer and one index buffer behind a single vertex array, so
+// draws of different meshes need no rebinding. Draws are queued as indirect commands and submitted
+// per program with one glMultiDrawElementsIndirect where the driver has it (GL 4.3 or
+// ARB_multi_draw_indirect); plain GL 3.3 replays the commands with glDrawElementsInstancedBaseVertex.
+//
+// Per-draw data comes from instance attributes: baseInstance selects a command's first instance.
+// Quantized meshes keep their own bounds, folded into the instance model matrix by instanceModel(),
+// so the shader's positionCenter/positionExtent decode stays the identity
+class MeshPool {
+public:
+    unsigned int VAO, VBO, EBO, indirectBuffer;
+    VertexFormat format;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+    // Take the GL 3.3 path even where multi-draw is available, for comparison
+    bool forceEmulation = false;
+
+    typedef int MeshId;
+    struct Entry {
+        GLuint firstIndex;
+        GLuint indexCount;
+        GLint baseVertex;
+        MeshBounds bounds;
+    };
+
+    // Commands and GL calls of the last submit() calls, reset with resetStats()
+    struct Stats {
+        int commands = 0;
+        int calls = 0;
+    };
+    Stats stats;
+
+    explicit MeshPool(VertexFormat vertexFormat = VERTEX_FLOAT) : format(vertexFormat) {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &indirectBuffer);
+    }
+    // Deletes the pool's GL objects, so it must not outlive the context
+    ~MeshPool() {
+        glState().deleteVertexArray(VAO);
+        glState().deleteBuffer(VBO);
+        glState().deleteBuffer(EBO);
+        glState().deleteBuffer(indirectBuffer);
+    }
+    MeshPool(const MeshPool&) = delete;
+    MeshPool &operator=(const MeshPool&) = delete;
+
+    // Stage a mesh for the next upload(). Indices stay relative to the mesh; baseVertex offsets them
+    MeshId add(const Mesh &mesh) {
+        Entry entry;
+        entry.firstIndex = (GLuint)indices.size();
+        entry.indexCount = (GLuint)mesh.indices.size();
+        entry.baseVertex = (GLint)vertexCount;
+        entry.bounds = meshBounds(mesh.vertices);
+        indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        if (format == VERTEX_QUANTIZED) {
+            std::vector<QuantizedVertex> quantized = quantizeVertices(mesh.vertices, entry.bounds);
+            append(quantized.data(), quantized.size() * sizeof(QuantizedVertex));
+        }
+        else {
+            append(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+        }
+        vertexCount += mesh.vertices.size();
+        largestMesh = std::max(largestMesh, mesh.vertices.size());
+        entries.push_back(entry);
+        return (MeshId)entries.size() - 1;
+    }
+
+    // Upload everything staged so far and set up the vertex array. Indices are 16-bit when every
+    // mesh's own vertices are addressable with them, as baseVertex covers the rest
+    void upload() {
+        glState().bindVertexArray(VAO);
+        glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexData.size(), vertexData.data(), GL_STATIC_DRAW);
+        glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if (largestMesh <= 0x10000) {
+            indexType = GL_UNSIGNED_SHORT;
+            std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+        }
+        else {
+            indexType = GL_UNSIGNED_INT;
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+        }
+        setVertexAttributes(format);
+        std::cout << "Mesh pool: " << entries.size() << " meshes, " << vertexCount << " vertices, "
+                  << indices.size() << (indexType == GL_UNSIGNED_SHORT ? " 16-bit" : " 32-bit") << " indices, "
+                  << (multiDrawSupported() ? "multi-draw indirect" : "emulated multi-draw") << std::endl;
+    }
+
+    const Entry &mesh(MeshId id) const {
+        return entries[id];
+    }
+    size_t size() const {
+        return entries.size();
+    }
+
+    // Model matrix for an instance of a mesh, including the dequantization of its positions
+    glm::mat4 instanceModel(MeshId id, const glm::mat4 &model) const {
+        if (format != VERTEX_QUANTIZED)
+            return model;
+        const MeshBounds &bounds = entries[id].bounds;
+        return glm::scale(glm::translate(model, bounds.center), bounds.extent);
+    }
+
+    static bool multiDrawSupported() {
+        return glext::MultiDrawElementsIndirect != nullptr;
+    }
+
+    // Queue a draw of instanceCount instances of a mesh, reading instance attributes from
+    // baseInstance onwards. Extends the previous command when it drew the instances just before
+    void draw(MeshId id, GLuint instanceCount = 1, GLuint baseInstance = 0) {
+        const Entry &entry = entries[id];
+        if (!commands.empty()) {
+            DrawElementsIndirectCommand &last = commands.back();
+            if (last.firstIndex == entry.firstIndex && last.baseVertex == entry.baseVertex &&
+                last.baseInstance + last.instanceCount == baseInstance) {
+                last.instanceCount += instanceCount;
+                return;
+            }
+        }
+        commands.push_back(DrawElementsIndirectCommand{ entry.indexCount, instanceCount, entry.firstIndex,
+                                                        entry.baseVertex, baseInstance });
+    }
+
+    // Issue every queued draw with the current program. instances is the buffer attached to the
+    // pool's vertex array, needed to emulate baseInstance when the driver cannot
+    void submit(InstanceBuffer *instances = nullptr) {
+        if (commands.empty())
+            return;
+        glState().bindVertexArray(VAO);
+        stats.commands += (int)commands.size();
+        if (multiDrawSupported() && !forceEmulation) {
+            glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            // Orphan so a submit never waits on the previous one's commands
+            size_t bytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, bytes, commands.data());
+            glext::MultiDrawElementsIndirect(GL_TRIANGLES, indexType, 0, (GLsizei)commands.size(), 0);
+            stats.calls++;
+        }
+        else {
+            size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+            GLuint currentBase = 0;
+            for (const DrawElementsIndirectCommand &command : commands) {
+                void *offset = (void*)(command.firstIndex * indexSize);
+                if (command.baseInstance && glext::DrawElementsInstancedBaseVertexBaseInstance) {
+                    glext::DrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, indexType, offset,
+                                                                       command.instanceCount, command.baseVertex, command.baseInstance);
+                    stats.calls++;
+                    continue;
+                }
+                if (command.baseInstance != currentBase && instances) {
+                    instances->setBaseInstance(command.baseInstance);
+                    currentBase = command.baseInstance;
+                }
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, indexType, offset,
+                                                  command.instanceCount, command.baseVertex);
+                stats.calls++;
+            }
+            if (currentBase && instances)
+                instances->setBaseInstance(0);
+        }
+        commands.clear();
+    }
+
+    void resetStats() {
+        stats = Stats();
+    }
+
+private:
+    std::vector<Entry> entries;
+    std::vector<unsigned char> vertexData;
+    std::vector<uint32_t> indices;
+    size_t vertexCount = 0;
+    size_t largestMesh = 0;
+    std::vector<DrawElementsIndirectCommand> commands;
+
+    void append(const void *data, size_t bytes) {
+        const unsigned char *begin = static_cast<const unsigned char*>(data);
+        vertexData.insert(vertexData.end(), begin, begin + bytes);
+    }
+};
+
+#endif
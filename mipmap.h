@@ -0,0 +1,386 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "worker_pool.h"
+
+// Filter taps and the sRGB encode have SIMD kernels, chosen at compile time
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIPMAP_AVX2 1
+#elif defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define MIPMAP_SSE 1
+#endif
+
+// Mip chains built on the CPU, in place of glGenerateMipmap. That averages whatever the texel values
+// are, which for most color images means gamma-encoded ones, offers no choice of filter, and on
+// software drivers is slow and runs on the GL thread. Here every level is resampled from the one
+// above it in floating point:
+//   - sRGB-encoded color is decoded to linear light through a table, filtered and encoded again
+//   - with alpha, color is filtered premultiplied so transparent texels do not bleed into the rest
+//   - the filter is separable: a box (area weights, so odd extents come out right), or a Kaiser
+//     windowed sinc or Lanczos-3 three texels wide, which keep distant levels sharper
+//   - alpha can be rescaled per level to keep the coverage of alpha-tested cutouts
+// Channels are as stb_image decodes them: grey, grey + alpha, RGB or RGBA.
+enum MipFilter { MIP_BOX, MIP_KAISER, MIP_LANCZOS };
+
+struct MipOptions {
+    MipFilter filter = MIP_BOX;
+    // Color holds sRGB-encoded values, as photographs and painted textures do. Clear it for data
+    // such as normal maps
+    bool srgb = true;
+    // Scale each level's alpha so the share of texels above alphaCutoff stays as in level 0
+    bool preserveCoverage = false;
+    float alphaCutoff = 0.5f;
+};
+
+const int SRGB_ENCODE_STEPS = 8192;
+
+struct SrgbTables {
+    float toLinear[256];
+    // Indexed by linear value * (SRGB_ENCODE_STEPS - 1). Padded so 32-bit gathers can read the last entry
+    uint8_t fromLinear[SRGB_ENCODE_STEPS + 3];
+};
+
+inline const SrgbTables &srgbTables() {
+    static const SrgbTables tables = [] {
+        SrgbTables built = {};
+        for (int i = 0; i < 256; i++) {
+            float value = i / 255.0f;
+            built.toLinear[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < SRGB_ENCODE_STEPS; i++) {
+            float value = i / (float)(SRGB_ENCODE_STEPS - 1);
+            float encoded = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+            built.fromLinear[i] = (uint8_t)std::lrint(encoded * 255.0f);
+        }
+        return built;
+    }();
+    return tables;
+}
+
+inline float mipSinc(float x) {
+    if (std::abs(x) < 1e-6f)
+        return 1.0f;
+    x *= 3.14159265f;
+    return std::sin(x) / x;
+}
+
+// Modified Bessel function of the first kind, order 0, for the Kaiser window
+inline float besselI0(float x) {
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; k < 20; k++) {
+        term *= (x / (2.0f * k)) * (x / (2.0f * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Weight of a sample x destination texels from the center, for the windowed-sinc filters
+inline float mipFilterWeight(MipFilter filter, float x) {
+    const float radius = 3.0f;
+    if (std::abs(x) >= radius)
+        return 0.0f;
+    if (filter == MIP_LANCZOS)
+        return mipSinc(x) * mipSinc(x / radius);
+    const float alpha = 4.0f;
+    float r = x / radius;
+    return mipSinc(x) * besselI0(alpha * std::sqrt(1.0f - r * r)) / besselI0(alpha);
+}
+
+// Source texels and weights for each destination texel along one axis, taps of each, padded with
+// zero weights. Taps past the edge fold onto the border texel
+struct MipAxis {
+    int taps = 0;
+    std::vector<int> index;
+    std::vector<float> weights;
+};
+
+inline MipAxis mipAxis(MipFilter filter, uint32_t source, uint32_t destination) {
+    float scale = (float)source / destination;
+    float radius = filter == MIP_BOX ? scale * 0.5f : 3.0f * scale;
+    std::vector<std::vector<std::pair<int, float>>> lists(destination);
+    MipAxis axis;
+    for (uint32_t o = 0; o < destination; o++) {
+        float center = (o + 0.5f) * scale;
+        float total = 0.0f;
+        for (int i = (int)std::floor(center - radius); i <= (int)std::ceil(center + radius); i++) {
+            float weight = filter == MIP_BOX ? std::min(i + 1.0f, center + radius) - std::max((float)i, center - radius)
+                                             : mipFilterWeight(filter, (i + 0.5f - center) / scale);
+            if (filter == MIP_BOX ? weight <= 0.0f : weight == 0.0f)
+                continue;
+            int clamped = std::min(std::max(i, 0), (int)source - 1);
+            if (!lists[o].empty() && lists[o].back().first == clamped)
+                lists[o].back().second += weight;
+            else
+                lists[o].push_back(std::make_pair(clamped, weight));
+            total += weight;
+        }
+        for (std::pair<int, float> &tap : lists[o])
+            tap.second /= total;
+        axis.taps = std::max(axis.taps, (int)lists[o].size());
+    }
+    axis.index.resize((size_t)destination * axis.taps);
+    axis.weights.resize((size_t)destination * axis.taps);
+    for (uint32_t o = 0; o < destination; o++) {
+        for (int k = 0; k < axis.taps; k++) {
+            bool used = k < (int)lists[o].size();
+            axis.index[(size_t)o * axis.taps + k] = used ? lists[o][k].first : lists[o].back().first;
+            axis.weights[(size_t)o * axis.taps + k] = used ? lists[o][k].second : 0.0f;
+        }
+    }
+    return axis;
+}
+
+#if defined(MIPMAP_AVX2)
+inline __m256 mipMultiplyAdd(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+#endif
+
+// Working levels are linear RGBA floats, color premultiplied when there is alpha
+
+// Horizontal pass: rows [begin, end) of source resampled along x into destination
+inline void mipFilterRows(const float *source, uint32_t sourceWidth, float *destination, uint32_t destinationWidth,
+                          const MipAxis &axis, size_t begin, size_t end) {
+    for (size_t y = begin; y < end; y++) {
+        const float *row = source + y * sourceWidth * 4;
+        float *out = destination + y * destinationWidth * 4;
+        uint32_t x = 0;
+#if defined(MIPMAP_AVX2)
+        // Two destination texels per register, each with its own taps
+        for (; x + 2 <= destinationWidth; x += 2) {
+            const int *index0 = &axis.index[(size_t)x * axis.taps], *index1 = index0 + axis.taps;
+            const float *weight0 = &axis.weights[(size_t)x * axis.taps], *weight1 = weight0 + axis.taps;
+            __m256 sum = _mm256_setzero_ps();
+            for (int k = 0; k < axis.taps; k++) {
+                __m256 texels = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(row + index0[k] * 4)), _mm_loadu_ps(row + index1[k] * 4), 1);
+                __m256 weights = _mm256_insertf128_ps(_mm256_set1_ps(weight0[k]), _mm_set1_ps(weight1[k]), 1);
+                sum = mipMultiplyAdd(texels, weights, sum);
+            }
+            _mm256_storeu_ps(out + x * 4, sum);
+        }
+#endif
+        for (; x < destinationWidth; x++) {
+            const int *index = &axis.index[(size_t)x * axis.taps];
+            const float *weight = &axis.weights[(size_t)x * axis.taps];
+#if defined(MIPMAP_AVX2) || defined(MIPMAP_SSE)
+            __m128 sum = _mm_setzero_ps();
+            for (int k = 0; k < axis.taps; k++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + index[k] * 4), _mm_set1_ps(weight[k])));
+            _mm_storeu_ps(out + x * 4, sum);
+#else
+            float sum[4] = {};
+            for (int k = 0; k < axis.taps; k++) {
+                for (int c = 0; c < 4; c++)
+                    sum[c] += row[index[k] * 4 + c] * weight[k];
+            }
+            memcpy(out + x * 4, sum, sizeof(sum));
+#endif
+        }
+    }
+}
+
+// Vertical pass: destination rows [begin, end), each a weighted sum of whole rows of rowFloats
+inline void mipFilterColumns(const float *source, float *destination, size_t rowFloats, const MipAxis &axis, size_t begin, size_t end) {
+    for (size_t y = begin; y < end; y++) {
+        const int *index = &axis.index[y * axis.taps];
+        const float *weight = &axis.weights[y * axis.taps];
+        float *out = destination + y * rowFloats;
+        size_t i = 0;
+#if defined(MIPMAP_AVX2)
+        for (; i + 8 <= rowFloats; i += 8) {
+            __m256 sum = _mm256_setzero_ps();
+            for (int k = 0; k < axis.taps; k++)
+                sum = mipMultiplyAdd(_mm256_loadu_ps(source + index[k] * rowFloats + i), _mm256_set1_ps(weight[k]), sum);
+            _mm256_storeu_ps(out + i, sum);
+        }
+#elif defined(MIPMAP_SSE)
+        for (; i + 4 <= rowFloats; i += 4) {
+            __m128 sum = _mm_setzero_ps();
+            for (int k = 0; k < axis.taps; k++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(source + index[k] * rowFloats + i), _mm_set1_ps(weight[k])));
+            _mm_storeu_ps(out + i, sum);
+        }
+#endif
+        for (; i < rowFloats; i++) {
+            float sum = 0.0f;
+            for (int k = 0; k < axis.taps; k++)
+                sum += source[index[k] * rowFloats + i] * weight[k];
+            out[i] = sum;
+        }
+    }
+}
+
+// Where each of an image's channels sits in a working texel: color first, alpha in the last slot
+struct MipLayout {
+    int channels;
+    int colorChannels;
+    bool alpha;
+    int slot[4];
+
+    explicit MipLayout(int channels) : channels(channels) {
+        alpha = channels == 2 || channels == 4;
+        colorChannels = alpha ? channels - 1 : channels;
+        for (int c = 0; c < 4; c++)
+            slot[c] = c < colorChannels ? c : 3;
+    }
+};
+
+// Rows [begin, end) of an 8-bit image into working texels
+inline void mipDecodeRows(const uint8_t *pixels, uint32_t width, const MipLayout &layout, bool srgb, float *level, size_t begin, size_t end) {
+    static const std::vector<float> unorm = [] {
+        std::vector<float> table(256);
+        for (int i = 0; i < 256; i++)
+            table[i] = i / 255.0f;
+        return table;
+    }();
+    const float *color = srgb ? srgbTables().toLinear : unorm.data();
+    for (size_t i = begin * width; i < end * width; i++) {
+        const uint8_t *texel = pixels + i * layout.channels;
+        float *out = level + i * 4;
+        float alpha = layout.alpha ? unorm[texel[layout.channels - 1]] : 1.0f;
+        out[0] = color[texel[0]] * alpha;
+        out[1] = layout.colorChannels > 1 ? color[texel[1]] * alpha : 0.0f;
+        out[2] = layout.colorChannels > 2 ? color[texel[2]] * alpha : 0.0f;
+        out[3] = alpha;
+    }
+}
+
+// Rows [begin, end) of working texels back to 8 bits, alpha scaled by alphaScale
+inline void mipEncodeRows(const float *level, uint32_t width, const MipLayout &layout, bool srgb, float alphaScale,
+                          uint8_t *pixels, size_t begin, size_t end) {
+    const uint8_t *fromLinear = srgbTables().fromLinear;
+    std::vector<uint8_t> rgba((size_t)width * 4);
+    for (size_t y = begin; y < end; y++) {
+        const float *row = level + y * width * 4;
+        uint32_t x = 0;
+#if defined(MIPMAP_AVX2)
+        const __m256i srgbLanes = _mm256_setr_epi32(srgb ? -1 : 0, srgb ? -1 : 0, srgb ? -1 : 0, 0,
+                                                    srgb ? -1 : 0, srgb ? -1 : 0, srgb ? -1 : 0, 0);
+        for (; x + 2 <= width; x += 2) {
+            __m256 texels = _mm256_loadu_ps(row + x * 4);
+            // Undo the premultiplication; color is 0 wherever alpha is
+            __m256 alpha = _mm256_permute_ps(texels, _MM_SHUFFLE(3, 3, 3, 3));
+            __m256 color = _mm256_div_ps(texels, _mm256_max_ps(alpha, _mm256_set1_ps(1e-8f)));
+            texels = _mm256_blend_ps(color, _mm256_mul_ps(texels, _mm256_set1_ps(alphaScale)), 0x88);
+            texels = _mm256_min_ps(_mm256_max_ps(texels, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+            __m256i step = _mm256_cvtps_epi32(_mm256_mul_ps(texels, _mm256_set1_ps((float)(SRGB_ENCODE_STEPS - 1))));
+            __m256i encoded = _mm256_and_si256(_mm256_i32gather_epi32((const int*)fromLinear, step, 1), _mm256_set1_epi32(0xFF));
+            __m256i direct = _mm256_cvtps_epi32(_mm256_mul_ps(texels, _mm256_set1_ps(255.0f)));
+            __m256i value = _mm256_blendv_epi8(direct, encoded, srgbLanes);
+            __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+            _mm_storel_epi64((__m128i*)(rgba.data() + x * 4), _mm_packus_epi16(words, words));
+        }
+#endif
+        for (; x < width; x++) {
+            const float *texel = row + x * 4;
+            float alpha = texel[3];
+            float unpremultiply = 1.0f / std::max(alpha, 1e-8f);
+            for (int c = 0; c < 4; c++) {
+                float value = c == 3 ? alpha * alphaScale : texel[c] * unpremultiply;
+                value = std::min(std::max(value, 0.0f), 1.0f);
+                rgba[x * 4 + c] = srgb && c < 3 ? fromLinear[(int)(value * (SRGB_ENCODE_STEPS - 1) + 0.5f)] : (uint8_t)(value * 255.0f + 0.5f);
+            }
+        }
+        uint8_t *out = pixels + y * width * layout.channels;
+        if (layout.channels == 4) {
+            memcpy(out, rgba.data(), (size_t)width * 4);
+            continue;
+        }
+        for (uint32_t i = 0; i < width; i++) {
+            for (int c = 0; c < layout.channels; c++)
+                out[(size_t)i * layout.channels + c] = rgba[(size_t)i * 4 + layout.slot[c]];
+        }
+    }
+}
+
+// Alpha scale that puts the share of texels above cutoff closest to target
+inline float coverageScale(const float *level, size_t count, float cutoff, float target) {
+    auto coverage = [&](float scale) {
+        size_t covered = 0;
+        for (size_t i = 0; i < count; i++)
+            covered += level[i * 4 + 3] * scale > cutoff;
+        return (float)covered / count;
+    };
+    float low = 0.0f, high = 4.0f;
+    for (int iteration = 0; iteration < 16; iteration++) {
+        float middle = (low + high) * 0.5f;
+        if (coverage(middle) < target)
+            low = middle;
+        else
+            high = middle;
+    }
+    return high;
+}
+
+// Every level of a tightly packed 8-bit image down to 1x1, level 0 being a copy of it. With a pool,
+// the rows of each pass are shared out across it
+inline std::vector<std::vector<uint8_t>> generateMipChain(const uint8_t *pixels, uint32_t width, uint32_t height, int channels,
+                                                          const MipOptions &options = MipOptions(), WorkerPool *pool = nullptr) {
+    MipLayout layout(channels);
+    bool srgb = options.srgb && layout.colorChannels > 0;
+    auto forRows = [&](size_t rows, const std::function<void(size_t, size_t, size_t)> &fn) {
+        if (pool && rows >= 32)
+            pool->parallelFor(rows, pool->chunksFor(rows, 16), fn);
+        else
+            fn(0, rows, 0);
+    };
+
+    std::vector<std::vector<uint8_t>> levels;
+    levels.emplace_back(pixels, pixels + (size_t)width * height * channels);
+    std::vector<float> current((size_t)width * height * 4), filtered, next;
+    forRows(height, [&](size_t begin, size_t end, size_t) {
+        mipDecodeRows(pixels, width, layout, srgb, current.data(), begin, end);
+    });
+
+    bool coverage = options.preserveCoverage && layout.alpha;
+    float targetCoverage = 0.0f;
+    if (coverage) {
+        size_t covered = 0;
+        for (size_t i = 0; i < (size_t)width * height; i++)
+            covered += pixels[i * channels + channels - 1] / 255.0f > options.alphaCutoff;
+        targetCoverage = (float)covered / ((size_t)width * height);
+    }
+
+    while (width > 1 || height > 1) {
+        uint32_t levelWidth = std::max<uint32_t>(width / 2, 1), levelHeight = std::max<uint32_t>(height / 2, 1);
+        MipAxis horizontal = mipAxis(options.filter, width, levelWidth);
+        MipAxis vertical = mipAxis(options.filter, height, levelHeight);
+        filtered.resize((size_t)levelWidth * height * 4);
+        next.resize((size_t)levelWidth * levelHeight * 4);
+        forRows(height, [&](size_t begin, size_t end, size_t) {
+            mipFilterRows(current.data(), width, filtered.data(), levelWidth, horizontal, begin, end);
+        });
+        forRows(levelHeight, [&](size_t begin, size_t end, size_t) {
+            mipFilterColumns(filtered.data(), next.data(), (size_t)levelWidth * 4, vertical, begin, end);
+        });
+
+        // Coverage scaling applies to what is stored; the next level still filters the true alpha
+        float alphaScale = coverage ? coverageScale(next.data(), (size_t)levelWidth * levelHeight, options.alphaCutoff, targetCoverage) : 1.0f;
+        levels.emplace_back((size_t)levelWidth * levelHeight * channels);
+        uint8_t *out = levels.back().data();
+        forRows(levelHeight, [&](size_t begin, size_t end, size_t) {
+            mipEncodeRows(next.data(), levelWidth, layout, srgb, alphaScale, out, begin, end);
+        });
+        current.swap(next);
+        width = levelWidth;
+        height = levelHeight;
+    }
+    return levels;
+}
+
+#endif
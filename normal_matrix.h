@@ -0,0 +1,102 @@
+#ifndef NORMAL_MATRIX_H
+#define NORMAL_MATRIX_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define NORMAL_MATRIX_SSE 1
+#endif
+
+// How a model matrix was built, recorded where the matrix is made so the normal matrix can skip
+// work the transform does not need
+enum TransformKind : uint8_t {
+    // Arbitrary linear part (non-uniform scale, shear): needs the full inverse-transpose
+    TRANSFORM_GENERAL,
+    // Rotation, translation and uniform scale only: the normal matrix is the upper 3x3 over scale^2
+    TRANSFORM_UNIFORM_SCALE,
+};
+
+// Normal matrix of one transform. The inverse-transpose of a 3x3 matrix is its cofactor matrix
+// over the determinant, and the cofactor columns are cross products of the columns, so no 4x4
+// (or even 3x3) inverse is needed
+inline glm::mat3 normalMatrix(const glm::mat4 &model, TransformKind kind = TRANSFORM_GENERAL) {
+    glm::vec3 c0(model[0]), c1(model[1]), c2(model[2]);
+    if (kind == TRANSFORM_UNIFORM_SCALE) {
+        float invScale2 = 1.0f / glm::dot(c0, c0);
+        return glm::mat3(c0 * invScale2, c1 * invScale2, c2 * invScale2);
+    }
+    glm::vec3 x = glm::cross(c1, c2), y = glm::cross(c2, c0), z = glm::cross(c0, c1);
+    float invDet = 1.0f / glm::dot(c0, x);
+    return glm::mat3(x * invDet, y * invDet, z * invDet);
+}
+
+#ifdef NORMAL_MATRIX_SSE
+// Four general normal matrices at once, structure-of-arrays across the four transforms
+inline void normalMatrices4(const glm::mat4 *const models[4], glm::mat3 *const out[4]) {
+    const float *m0 = &(*models[0])[0][0];
+    const float *m1 = &(*models[1])[0][0];
+    const float *m2 = &(*models[2])[0][0];
+    const float *m3 = &(*models[3])[0][0];
+    // a[column][row] holds that element of all four matrices
+    __m128 a[3][3];
+    for (int column = 0; column < 3; column++)
+        for (int row = 0; row < 3; row++)
+            a[column][row] = _mm_setr_ps(m0[column * 4 + row], m1[column * 4 + row], m2[column * 4 + row], m3[column * 4 + row]);
+
+    // Cofactor columns: cross(c1, c2), cross(c2, c0), cross(c0, c1)
+    __m128 cof[3][3];
+    for (int column = 0; column < 3; column++) {
+        const __m128 *u = a[(column + 1) % 3];
+        const __m128 *v = a[(column + 2) % 3];
+        cof[column][0] = _mm_sub_ps(_mm_mul_ps(u[1], v[2]), _mm_mul_ps(u[2], v[1]));
+        cof[column][1] = _mm_sub_ps(_mm_mul_ps(u[2], v[0]), _mm_mul_ps(u[0], v[2]));
+        cof[column][2] = _mm_sub_ps(_mm_mul_ps(u[0], v[1]), _mm_mul_ps(u[1], v[0]));
+    }
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0][0], cof[0][0]), _mm_mul_ps(a[0][1], cof[0][1])),
+                            _mm_mul_ps(a[0][2], cof[0][2]));
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    alignas(16) float lanes[4];
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) {
+            _mm_store_ps(lanes, _mm_mul_ps(cof[column][row], invDet));
+            for (int i = 0; i < 4; i++)
+                (*out[i])[column][row] = lanes[i];
+        }
+    }
+}
+#endif
+
+// Batched normal matrices for every object in a frame. kinds may be null (all general).
+// Uniform-scale transforms take the scalar fast path; general ones go through the SIMD kernel
+// four at a time
+inline void computeNormalMatrices(const glm::mat4 *models, const TransformKind *kinds, glm::mat3 *out, size_t count) {
+#ifdef NORMAL_MATRIX_SSE
+    const glm::mat4 *batchIn[4];
+    glm::mat3 *batchOut[4];
+    int batched = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (kinds && kinds[i] == TRANSFORM_UNIFORM_SCALE) {
+            out[i] = normalMatrix(models[i], TRANSFORM_UNIFORM_SCALE);
+            continue;
+        }
+        batchIn[batched] = &models[i];
+        batchOut[batched] = &out[i];
+        if (++batched == 4) {
+            normalMatrices4(batchIn, batchOut);
+            batched = 0;
+        }
+    }
+    for (int i = 0; i < batched; i++)
+        *batchOut[i] = normalMatrix(*batchIn[i], TRANSFORM_GENERAL);
+#else
+    for (size_t i = 0; i < count; i++)
+        out[i] = normalMatrix(models[i], kinds ? kinds[i] : TRANSFORM_GENERAL);
+#endif
+}
+
+#endif
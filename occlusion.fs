@@ -0,0 +1,7 @@
+#version 330 core
+out vec4 FragColor;
+
+// Only the samples passing the depth test matter; color writes are masked off
+void main() {
+    FragColor = vec4(1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// World-space box tested by an occlusion query; aPos spans the unit cube -1..1
+uniform vec3 boxCenter;
+uniform vec3 boxExtent;
+
+#include "frame_data.glsl"
+
+void main() {
+    gl_Position = projection * view * vec4(aPos * boxExtent + boxCenter, 1.0);
+}
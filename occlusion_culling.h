@@ -0,0 +1,215 @@
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "shader.h"
+#include "gl_state.h"
+#include "vertex_format.h"
+
+// Hardware occlusion culling on top of frustum culling. After the frame's draws, each object's
+// world bounding box is rasterized with color and depth writes off inside a GL_ANY_SAMPLES_PASSED
+// query, against the depth the frame left behind. Results are read on later frames, and only once
+// GL_QUERY_RESULT_AVAILABLE reports them, so the CPU never waits on the GPU. While an object's query
+// is still in flight it is drawn inside glBeginConditionalRender on that query, letting the GPU
+// drop the draw if the box turned out hidden.
+//
+// Temporal coherence keeps the query count down: an occluded object is queried every frame so it
+// shows up again as soon as it comes into view, while a visible one is assumed to stay visible and
+// is only re-queried every requeryInterval frames, staggered by object index.
+//
+// Everything used is core GL 3.3, so this also runs on software drivers such as Mesa llvmpipe
+class OcclusionCuller {
+public:
+    enum Visibility {
+        OCCLUSION_VISIBLE,
+        OCCLUSION_OCCLUDED,
+        // Result still pending: draw conditionally on query(object)
+        OCCLUSION_CONDITIONAL,
+    };
+
+    // Counts for the frames since resetStats()
+    struct Stats {
+        int tested = 0;
+        int occluded = 0;
+        int conditional = 0;
+        int queries = 0;
+    };
+    Stats stats;
+
+    // Frames a visible object goes without a query
+    unsigned int requeryInterval = 8;
+    // Camera near plane distance. A box closer than this to the camera is clipped and can pass no samples
+    float nearPlane = 0.1f;
+
+    unsigned int VAO, VBO, EBO;
+
+    // program draws the proxy boxes, see occlusion.vs. Queries wait for it to finish building
+    explicit OcclusionCuller(Shader *program) : program(program) {
+        // Unit cube corners and its 12 triangles
+        const float corners[] = {
+            -1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,   1.0f,  1.0f, -1.0f,  -1.0f,  1.0f, -1.0f,
+            -1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,   1.0f,  1.0f,  1.0f,  -1.0f,  1.0f,  1.0f,
+        };
+        const GLubyte indices[BOX_INDEX_COUNT] = {
+            0, 2, 1,  0, 3, 2,   4, 5, 6,  4, 6, 7,   0, 4, 7,  0, 7, 3,
+            1, 2, 6,  1, 6, 5,   0, 1, 5,  0, 5, 4,   3, 7, 6,  3, 6, 2,
+        };
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glState().bindVertexArray(VAO);
+        glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    }
+    // Query objects and proxy box buffers are GL names, released while the context is current
+    ~OcclusionCuller() {
+        resize(0);
+        glState().deleteVertexArray(VAO);
+        glState().deleteBuffer(VBO);
+        glState().deleteBuffer(EBO);
+    }
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller &operator=(const OcclusionCuller&) = delete;
+
+    // One query per object; objects start out visible
+    void resize(size_t count) {
+        while (objects.size() > count) {
+            glDeleteQueries(1, &objects.back().query);
+            objects.pop_back();
+        }
+        while (objects.size() < count) {
+            Object object;
+            glGenQueries(1, &object.query);
+            objects.push_back(object);
+        }
+    }
+    size_t size() const {
+        return objects.size();
+    }
+
+    // Collect every query result that has arrived. Call once per frame before classify()
+    void beginFrame() {
+        frame++;
+        for (Object &object : objects) {
+            if (!object.pending)
+                continue;
+            GLuint available = 0;
+            glGetQueryObjectuiv(object.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint passed = 0;
+            glGetQueryObjectuiv(object.query, GL_QUERY_RESULT, &passed);
+            object.visible = passed != 0;
+            object.pending = false;
+        }
+    }
+
+    // How to draw an object that passed frustum culling this frame
+    Visibility classify(uint32_t index) {
+        Object &object = objects[index];
+        bool inViewLastFrame = object.lastClassified + 1 == frame;
+        object.lastClassified = frame;
+        stats.tested++;
+        if (object.pending) {
+            stats.conditional++;
+            return OCCLUSION_CONDITIONAL;
+        }
+        // A result from before the object left the view says nothing about it now
+        if (!inViewLastFrame)
+            object.visible = true;
+        if (!object.visible) {
+            stats.occluded++;
+            return OCCLUSION_OCCLUDED;
+        }
+        return OCCLUSION_VISIBLE;
+    }
+    GLuint query(uint32_t index) const {
+        return objects[index].query;
+    }
+
+    // Query the listed objects that are due one, against the depth buffer as the frame's draws left
+    // it. bounds are world-space and indexed by object. Leaves color and depth writes on
+    void issueQueries(const MeshBounds *bounds, const uint32_t *list, size_t count, const glm::vec3 &viewPosition) {
+        if (!program->isReady())
+            return;
+        if (!boxUniforms) {
+            centerUniform = program->uniform("boxCenter");
+            extentUniform = program->uniform("boxExtent");
+            boxUniforms = true;
+        }
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glState().setEnabled(GL_DEPTH_TEST, true);
+        glState().setEnabled(GL_BLEND, false);
+        // Back faces still pass when the front ones are clipped away
+        glState().setEnabled(GL_CULL_FACE, false);
+        program->use();
+        glState().bindVertexArray(VAO);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t index = list[i];
+            Object &object = objects[index];
+            if (object.pending || (object.visible && (frame + index) % requeryInterval != 0))
+                continue;
+            // Grown so the box is never depth-equal to the object's own surfaces
+            const MeshBounds &box = bounds[index];
+            glm::vec3 extent = box.extent * (1.0f + BOX_SCALE) + glm::vec3(BOX_MARGIN);
+            if (containsPoint(box.center, extent + glm::vec3(nearPlane), viewPosition)) {
+                object.visible = true;
+                continue;
+            }
+            program->setVec3(centerUniform, box.center);
+            program->setVec3(extentUniform, extent);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, object.query);
+            glDrawElements(GL_TRIANGLES, BOX_INDEX_COUNT, GL_UNSIGNED_BYTE, 0);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            object.pending = true;
+            stats.queries++;
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+    }
+
+    void resetStats() {
+        stats = Stats();
+    }
+
+private:
+    static const int BOX_INDEX_COUNT = 36;
+    static constexpr float BOX_SCALE = 0.01f;
+    static constexpr float BOX_MARGIN = 0.001f;
+
+    struct Object {
+        GLuint query = 0;
+        // Last query result; true until the first one arrives
+        bool visible = true;
+        // Issued and not read back yet
+        bool pending = false;
+        uint32_t lastClassified = 0;
+    };
+    std::vector<Object> objects;
+    uint32_t frame = 0;
+
+    Shader *program;
+    Shader::Uniform centerUniform;
+    Shader::Uniform extentUniform;
+    bool boxUniforms = false;
+
+    static bool containsPoint(const glm::vec3 &center, const glm::vec3 &extent, const glm::vec3 &point) {
+        return std::abs(point.x - center.x) <= extent.x &&
+               std::abs(point.y - center.y) <= extent.y &&
+               std::abs(point.z - center.z) <= extent.z;
+    }
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "shader.h"
+#include "mesh_pool.h"
+#include "command_buffer.h"
+
+// Textures a draw samples; 0 leaves whatever is bound on that unit
+struct Material {
+    GLuint diffuse = 0;
+    GLuint specular = 0;
+};
+
+enum RenderPass : uint8_t {
+    PASS_OPAQUE,
+    PASS_OVERLAY,
+};
+
+// A frame's draws, sorted by 64-bit key before submission so that draws sharing a program,
+// textures and vertex array end up adjacent, and opaque draws go front to back for early-z.
+//
+// Key layout, most significant first:
+//   opaque:       pass:2 | translucent:1 = 0 | program:10 | material:12 | vertex array:8 | depth:24 | 7 spare
+//   translucent:  pass:2 | translucent:1 = 1 | inverted depth:24 | program:10 | material:12 | vertex array:8
+// The program, material and vertex array fields are hashes of the GL names: a collision only costs
+// grouping, as record() compares the real state
+class RenderQueue {
+public:
+    struct Draw {
+        Shader *program;
+        const Material *material;
+        MeshPool *pool;
+        MeshPool::MeshId mesh;
+        // Caller's index for the object, e.g. into its transforms
+        uint32_t object;
+        // Occlusion query the draw is conditional on, 0 for none
+        GLuint condition = 0;
+    };
+
+    // State switches the draws need in insertion order and in sorted order, for the last sort()
+    struct Stats {
+        int draws = 0;
+        int unsortedChanges = 0;
+        int sortedChanges = 0;
+    };
+    Stats stats;
+
+    // Camera depth range mapped onto the 24 depth bits
+    float nearDepth = 0.1f;
+    float farDepth = 100.0f;
+
+    void clear() {
+        draws.clear();
+        translucency.clear();
+        keys.clear();
+    }
+
+    // viewDepth is the distance along the view direction, e.g. -(view * position).z
+    void add(const Draw &draw, float viewDepth, RenderPass pass = PASS_OPAQUE, bool translucent = false) {
+        uint64_t depth = quantizeDepth(viewDepth);
+        uint64_t program = draw.program->ID & 0x3FF;
+        uint64_t material = materialBits(draw.material);
+        uint64_t vertexArray = draw.pool->VAO & 0xFF;
+        uint64_t key = (uint64_t)pass << 62;
+        if (translucent) {
+            // Back to front, then by state
+            key |= 1ull << 61 | (0xFFFFFF - depth) << 37 | program << 27 | material << 15 | vertexArray << 7;
+        }
+        else {
+            key |= program << 51 | material << 39 | vertexArray << 31 | depth << 7;
+        }
+        keys.push_back(Entry{ key, (uint32_t)draws.size() });
+        draws.push_back(draw);
+        translucency.push_back(translucent);
+    }
+
+    // Order the draws by key, recording how many state switches that saves
+    void sort() {
+        stats.draws = (int)draws.size();
+        stats.unsortedChanges = countStateChanges();
+        radixSort();
+        stats.sortedChanges = countStateChanges();
+    }
+
+    size_t size() const {
+        return keys.size();
+    }
+    // The i-th draw in submission order
+    const Draw &sorted(size_t i) const {
+        return draws[keys[i].index];
+    }
+
+    // Record sorted draws [begin, end) for replay. Draw i reads instance i of the instance buffer,
+    // which the caller fills in submission order. State is compared against the draw before begin,
+    // whichever slice that fell in, so slices recorded on different threads and replayed in order
+    // give the same stream as one recording of the whole queue. Runs of the same mesh with the same
+    // state merge into one instanced command at replay, except draws with a condition.
+    // Reads only the sorted queue, so disjoint slices can be recorded concurrently
+    void record(CommandBuffer &commands, size_t begin, size_t end) const {
+        for (size_t i = begin; i < end; i++) {
+            const Draw &draw = draws[keys[i].index];
+            bool translucent = translucency[keys[i].index];
+            if (i == 0 || stateChanged(draws[keys[i - 1].index], translucency[keys[i - 1].index], draw, translucent))
+                recordState(commands, draw, translucent);
+            // A conditional draw stands alone, as each has its own query
+            if (draw.condition)
+                commands.beginConditional(draw.condition);
+            commands.drawMesh(draw.pool, draw.mesh, 1, (uint32_t)i);
+            if (draw.condition)
+                commands.endConditional();
+        }
+        // Leave blending off for whatever draws after the queue
+        if (end == keys.size() && end > begin && translucency[keys[end - 1].index])
+            commands.setBlend(false);
+    }
+
+private:
+    struct Entry {
+        uint64_t key;
+        uint32_t index;
+    };
+    std::vector<Draw> draws;
+    std::vector<bool> translucency;
+    std::vector<Entry> keys;
+    std::vector<Entry> scratch;
+
+    uint64_t quantizeDepth(float viewDepth) const {
+        float t = (viewDepth - nearDepth) / (farDepth - nearDepth);
+        t = std::min(std::max(t, 0.0f), 1.0f);
+        return (uint64_t)(t * 0xFFFFFF);
+    }
+    static uint64_t materialBits(const Material *material) {
+        if (!material)
+            return 0;
+        return (material->diffuse & 0x3F) << 6 | (material->specular & 0x3F);
+    }
+
+    // LSD radix sort on 8-bit digits. Digits every key shares are skipped, which with mostly
+    // empty fields is most of them
+    void radixSort() {
+        scratch.resize(keys.size());
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t counts[256] = {};
+            for (const Entry &entry : keys)
+                counts[(entry.key >> shift) & 0xFF]++;
+            if (counts[(keys.empty() ? 0 : keys[0].key >> shift) & 0xFF] == keys.size())
+                continue;
+            size_t offset = 0;
+            for (size_t &count : counts) {
+                size_t start = offset;
+                offset += count;
+                count = start;
+            }
+            for (const Entry &entry : keys)
+                scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+            keys.swap(scratch);
+        }
+    }
+
+    static bool stateChanged(const Draw &a, bool aTranslucent, const Draw &b, bool bTranslucent) {
+        return a.program != b.program || a.pool != b.pool || aTranslucent != bTranslucent ||
+               (b.material && (!a.material || a.material->diffuse != b.material->diffuse || a.material->specular != b.material->specular));
+    }
+    static void recordState(CommandBuffer &commands, const Draw &draw, bool translucent) {
+        commands.bindProgram(draw.program);
+        if (draw.material) {
+            if (draw.material->diffuse)
+                commands.bindTexture(0, draw.material->diffuse);
+            if (draw.material->specular)
+                commands.bindTexture(1, draw.material->specular);
+        }
+        commands.setBlend(translucent);
+    }
+
+    // Program, texture and vertex array switches needed to issue the draws in the current order
+    int countStateChanges() const {
+        int changes = 0;
+        const Draw *previous = nullptr;
+        GLuint textures[2] = { 0, 0 };
+        for (const Entry &entry : keys) {
+            const Draw &draw = draws[entry.index];
+            if (!previous || previous->program != draw.program)
+                changes++;
+            if (!previous || previous->pool != draw.pool)
+                changes++;
+            if (draw.material) {
+                GLuint wanted[2] = { draw.material->diffuse, draw.material->specular };
+                for (int unit = 0; unit < 2; unit++) {
+                    if (wanted[unit] && wanted[unit] != textures[unit]) {
+                        textures[unit] = wanted[unit];
+                        changes++;
+                    }
+                }
+            }
+            previous = &draw;
+        }
+        return changes;
+    }
+};
+
+#endif
@@ -1,43 +1,50 @@
 #version 330 core
 out vec4 FragColor;
 
-struct Material {
-    sampler2D diffuse;
-    sampler2D specular;
-    float     shininess;
-};
-
-struct Light {
-    vec3 position;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
+// Permutation defines (see shader_variants.h):
+//   SPECULAR_MAP  sample material.specular instead of a flat specular colour
+//   NUM_LIGHTS n  number of lights in light[], 1 by default
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS 1
+#endif
+
+#include "lighting.glsl"
 
 in vec3 Normal;
 in vec3 FragPos;
 in vec2 TexCoords;
 
-uniform vec3 viewPos;
+#include "frame_data.glsl"
+
 uniform Material material;
-uniform Light light;
+uniform Light light[NUM_LIGHTS];
     
 void main() {
-    // Ambient
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    
-    // Diffuse
+    vec3 diffuseColor = vec3(texture(material.diffuse, TexCoords));
+#ifdef SPECULAR_MAP
+    vec3 specularColor = vec3(texture(material.specular, TexCoords));
+#else
+    vec3 specularColor = vec3(0.5);
+#endif
     vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(light.position - FragPos);
-    float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    
-    vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 reflectDir = reflect(-lightDir, norm);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
-    
-    vec3 result = ambient + diffuse + specular;
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
+
+    vec3 result = vec3(0.0);
+    for (int i = 0; i < NUM_LIGHTS; i++) {
+        // Ambient
+        vec3 ambient = light[i].ambient * diffuseColor;
+        
+        // Diffuse
+        vec3 lightDir = normalize(light[i].position - FragPos);
+        float diff = max(dot(norm, lightDir), 0.0);
+        vec3 diffuse = light[i].diffuse * diff * diffuseColor;
+        
+        vec3 reflectDir = reflect(-lightDir, norm);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+        vec3 specular = light[i].specular * spec * specularColor;
+        
+        result += ambient + diffuse + specular;
+    }
     FragColor = vec4(result, 1.0);
 }
 
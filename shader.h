@@ -2,124 +2,655 @@
 #define SHADER_H
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 
 #include <string>
+#include <vector>
 #include <fstream>
-#include <sstream>
 #include <iostream>
+#include <filesystem>
+#include <system_error>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <algorithm>
+
+#include "hash.h"
+#include "gl_ext.h"
+#include "shader_source.h"
+#include "gl_state.h"
 
 class Shader {
 public:
+    // Handle to a cached uniform location. Resolve once with uniform() and reuse every frame
+    struct Uniform {
+        int slot = -1;
+        bool valid() const { return slot >= 0; }
+    };
+
     // Program ID
     unsigned int ID;
-    // Read and build shader
-    Shader(const char* vertexPath, const char* fragmentPath) {
-        // Retrieve the vertex and fragment source code form filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // Ensure ifstream objects can throw exceptions
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try {
-            // Open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // Read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // Close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // Convert stream intro string
-            vertexCode   = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch(std::ifstream::failure e) {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        
-        // Compile shaders
-        unsigned int vertex, fragment;
-        
-        // Vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        
-        // Fragment shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        
-        // Shader program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        
-        // Delete the shaders as they're now linked into program
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+    // Blocking builds are checked before the constructor returns. Deferred builds only submit the
+    // compile and link so several programs can build in parallel; poll isReady() or call finish()
+    enum BuildMode { Blocking, Deferred };
+
+    // Read and build shader. Each define ("NAME" or "NAME value") is injected after the #version line
+    Shader(const char* vertexPath, const char* fragmentPath, BuildMode mode = Blocking,
+           const std::vector<std::string> &defines = std::vector<std::string>())
+        : vertexPath(vertexPath), fragmentPath(fragmentPath) {
+        for (const std::string &define : defines)
+            definePreamble += "#define " + define + "\n";
+
+        pending = submit();
+        ID = pending.program;
+        if (mode == Blocking)
+            finish();
+    }
+
+    // Non-blocking completion poll. With KHR_parallel_shader_compile this never waits on the
+    // driver; without it the first call finishes the build synchronously.
+    // Stays false if the build failed, so callers can keep drawing with a fallback program
+    bool isReady() {
+        if (state == Pending && buildCompleted(pending))
+            finish();
+        return state == Ready;
+    }
+
+    // Wait for the build, report compile/link errors and set up uniform tables
+    void finish() {
+        if (state != Pending)
+            return;
+        state = finishBuild(pending) ? Ready : Failed;
+        if (state == Ready) {
+            bindUniformBlocks();
+            buildUniformTable();
+        }
+    }
+
+    // Source files this program is built from, including everything they #include
+    bool dependsOn(const std::string &path) const {
+        return std::find(dependencies.begin(), dependencies.end(), path) != dependencies.end();
+    }
+
+    // Rebuild from the source files without stalling. The running program stays active until
+    // pollReload() sees the new one link, so a broken edit never leaves the shader unusable
+    void reload() {
+        if (state == Pending || reloading.submitted)
+            return;
+        for (const std::string &path : dependencies)
+            ShaderSourceLoader::instance().invalidate(path);
+        if (state == Failed) {
+            // Nothing to keep running, retry as a fresh build
+            glState().deleteProgram(ID);
+            pending = submit();
+            ID = pending.program;
+            state = Pending;
+            return;
+        }
+        reloading = submit();
+    }
+
+    enum ReloadStatus { NoReload, Reloading, Reloaded, ReloadFailed };
+
+    // Call once per frame. Swaps in the reloaded program once it has linked, re-applying every
+    // uniform value set on the old one
+    ReloadStatus pollReload() {
+        if (!reloading.submitted)
+            return NoReload;
+        if (!buildCompleted(reloading))
+            return Reloading;
+        Build build = reloading;
+        reloading = Build();
+        if (!finishBuild(build)) {
+            if (build.program)
+                glDeleteProgram(build.program);
+            return ReloadFailed;
+        }
+        glState().deleteProgram(ID);
+        ID = build.program;
+        bindUniformBlocks();
+        buildUniformTable();
+        restoreUniformValues();
+        return Reloaded;
+    }
+
+    // Finish a batch of deferred programs. All were submitted before any status is queried
+    static void finishAll(std::initializer_list<Shader*> shaders) {
+        for (Shader *shader : shaders)
+            shader->finish();
+    }
+
+    // Enable the on-disk program binary cache for programs built after this call. Empty disables it
+    static void setBinaryCacheDirectory(const std::string &directory) {
+        binaryCacheDirectory() = directory;
+    }
+    struct BinaryCacheStats {
+        int hits = 0;
+        int misses = 0;
+    };
+    static BinaryCacheStats &binaryCacheStats() {
+        static BinaryCacheStats stats;
+        return stats;
+    }
+
+    // glUniform* calls issued vs skipped as redundant, across all programs. Reset once per frame
+    struct UploadStats {
+        int issued = 0;
+        int skipped = 0;
+    };
+    static UploadStats &uploadStats() {
+        static UploadStats stats;
+        return stats;
+    }
+    static void resetUploadStats() {
+        uploadStats() = UploadStats();
+    }
+
+    // Bind the uniform block called blockName to a binding point in every program linked after this call
+    static void setBlockBinding(const char *blockName, GLuint binding) {
+        blockBindings().push_back(BlockBinding{ hashString(blockName), binding });
     }
     
     // Use and activate the shader
     void use() {
-        glUseProgram(ID);
+        glState().useProgram(ID);
+    }
+    // Look up a cached uniform handle. Names are hashed, no GL call or allocation is made
+    Uniform uniform(const char *name) const {
+        return findUniform(hashString(name));
+    }
+    Uniform findUniform(uint32_t nameHash) const {
+        if (uniformBuckets.empty())
+            return Uniform{};
+        size_t mask = uniformBuckets.size() - 1;
+        for (size_t i = nameHash & mask; uniformBuckets[i].slot >= 0; i = (i + 1) & mask) {
+            if (uniformBuckets[i].hash == nameHash)
+                return Uniform{ uniformBuckets[i].slot };
+        }
+        return Uniform{};
     }
+    GLint location(Uniform u) const {
+        return u.valid() ? uniforms[u.slot].location : -1;
+    }
+    // Number of active uniforms found at link time (array elements counted individually)
+    size_t uniformCount() const {
+        return uniforms.size();
+    }
+
     // Utility uniform functions
     void setBool(const std::string &name, bool value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        setBool(uniform(name.c_str()), value);
     }
     void setInt(const std::string &name, int value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        setInt(uniform(name.c_str()), value);
     }
     void setFloat(const std::string &name, float value) const {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        setFloat(uniform(name.c_str()), value);
     }
     void setVec2(const std::string &name, const glm::vec2 &value) const {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec2(uniform(name.c_str()), value);
     }
     void setVec2(const std::string &name, float x, float y) const {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        setVec2(uniform(name.c_str()), glm::vec2(x, y));
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec3(uniform(name.c_str()), value);
     }
     void setVec3(const std::string &name, float x, float y, float z) const {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        setVec3(uniform(name.c_str()), glm::vec3(x, y, z));
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec4(uniform(name.c_str()), value);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        setVec4(uniform(name.c_str()), glm::vec4(x, y, z, w));
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(uniform(name.c_str()), mat);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(uniform(name.c_str()), mat);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(uniform(name.c_str()), mat);
+    }
+
+    // Handle based uniform functions. No string building or location lookup per call
+    void setBool(Uniform u, bool value) const {
+        int i = (int)value;
+        setValue(u, Int1, &i, sizeof(i));
+    }
+    void setInt(Uniform u, int value) const {
+        setValue(u, Int1, &value, sizeof(value));
+    }
+    void setFloat(Uniform u, float value) const {
+        setValue(u, Float1, &value, sizeof(value));
+    }
+    void setVec2(Uniform u, const glm::vec2 &value) const {
+        setValue(u, Float2, &value[0], 2 * sizeof(float));
+    }
+    void setVec3(Uniform u, const glm::vec3 &value) const {
+        setValue(u, Float3, &value[0], 3 * sizeof(float));
+    }
+    void setVec4(Uniform u, const glm::vec4 &value) const {
+        setValue(u, Float4, &value[0], 4 * sizeof(float));
+    }
+    void setMat2(Uniform u, const glm::mat2 &mat) const {
+        setValue(u, Mat2, &mat[0][0], 4 * sizeof(float));
+    }
+    void setMat3(Uniform u, const glm::mat3 &mat) const {
+        setValue(u, Mat3, &mat[0][0], 9 * sizeof(float));
+    }
+    void setMat4(Uniform u, const glm::mat4 &mat) const {
+        setValue(u, Mat4, &mat[0][0], 16 * sizeof(float));
     }
 private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    // "#define ..." lines inserted into both stages
+    std::string definePreamble;
+    // Every file read for the last build, for hot reload
+    std::vector<std::string> dependencies;
+
+    // Which glUniform* call uploads a cached value
+    enum ValueKind : uint8_t { NoValue, Int1, Float1, Float2, Float3, Float4, Mat2, Mat3, Mat4 };
+
+    struct UniformInfo {
+        uint32_t hash;
+        GLint location;
+        GLenum type;
+        std::string name;
+        // Last value set through this shader: re-applied when the program is relinked and compared
+        // against to skip redundant uploads
+        ValueKind kind;
+        alignas(16) unsigned char value[64];
+    };
+    // Slot indexed uniform table and an open addressing hash index into it (slot -1 marks an empty bucket).
+    // Slots stay stable across reloads so handles resolved before a reload remain valid
+    mutable std::vector<UniformInfo> uniforms;
+    struct UniformBucket {
+        uint32_t hash;
+        int slot;
+    };
+    std::vector<UniformBucket> uniformBuckets;
+    // Bare array names resolve to the slot of element 0, so each location has a single cached value
+    struct UniformAlias {
+        uint32_t hash;
+        int slot;
+        std::string name;
+    };
+    std::vector<UniformAlias> uniformAliases;
+
+    void setValue(Uniform u, ValueKind kind, const void *data, size_t size) const {
+        if (!u.valid())
+            return;
+        UniformInfo &info = uniforms[u.slot];
+        // The cached value mirrors what the program holds, so a bit-identical set is a no-op
+        if (info.kind == kind && memcmp(info.value, data, size) == 0) {
+            uploadStats().skipped++;
+            return;
+        }
+        // glUniform* writes to whichever program is bound, so bind this one before the shadow
+        // records the value. Free when it is already current
+        glState().useProgram(ID);
+        info.kind = kind;
+        memcpy(info.value, data, size);
+        uploadValue(info.location, kind, info.value);
+        uploadStats().issued++;
+    }
+    static void uploadValue(GLint location, ValueKind kind, const void *value) {
+        const GLint *i = static_cast<const GLint*>(value);
+        const GLfloat *f = static_cast<const GLfloat*>(value);
+        switch (kind) {
+            case Int1:   glUniform1iv(location, 1, i); break;
+            case Float1: glUniform1fv(location, 1, f); break;
+            case Float2: glUniform2fv(location, 1, f); break;
+            case Float3: glUniform3fv(location, 1, f); break;
+            case Float4: glUniform4fv(location, 1, f); break;
+            case Mat2:   glUniformMatrix2fv(location, 1, GL_FALSE, f); break;
+            case Mat3:   glUniformMatrix3fv(location, 1, GL_FALSE, f); break;
+            case Mat4:   glUniformMatrix4fv(location, 1, GL_FALSE, f); break;
+            case NoValue: break;
+        }
+    }
+    // Upload every cached value into the program, leaving it bound
+    // ------------------------------------------------------------------------
+    void restoreUniformValues() {
+        use();
+        for (const UniformInfo &info : uniforms) {
+            if (info.kind != NoValue && info.location >= 0)
+                uploadValue(info.location, info.kind, info.value);
+        }
+    }
+
+    struct BlockBinding {
+        uint32_t hash;
+        GLuint binding;
+    };
+    static std::vector<BlockBinding> &blockBindings() {
+        static std::vector<BlockBinding> bindings;
+        return bindings;
+    }
+
+    enum State { Pending, Ready, Failed };
+    State state = Pending;
+
+    // GL objects of a submitted but not yet checked build
+    struct Build {
+        bool submitted = false;
+        // A source file or #include could not be read, so nothing was handed to GL
+        bool sourceMissing = false;
+        GLuint program = 0;
+        GLuint vertex = 0;
+        GLuint fragment = 0;
+        std::string cachePath;
+        bool fromBinary = false;
+        // Source string number to file mapping for error messages
+        std::string vertexFiles;
+        std::string fragmentFiles;
+    };
+    Build pending;
+    // A program being rebuilt by reload(), swapped in by pollReload()
+    Build reloading;
+
+    // Start compiling and linking without querying any status, which would force the driver to
+    // finish the work synchronously
+    // ------------------------------------------------------------------------
+    Build submit() {
+        // Sources are assembled from mapped files and passed to GL as a list of pieces, never
+        // concatenated into one copy
+        ShaderSource vertexSource, fragmentSource;
+        ShaderSourceLoader &loader = ShaderSourceLoader::instance();
+        bool vertexLoaded = loader.assemble(vertexPath, definePreamble, vertexSource);
+        bool fragmentLoaded = loader.assemble(fragmentPath, definePreamble, fragmentSource);
+        // Missing files stay in the list, so hot reload retries once they appear
+        dependencies = vertexSource.files;
+        dependencies.insert(dependencies.end(), fragmentSource.files.begin(), fragmentSource.files.end());
+
+        Build build;
+        build.submitted = true;
+        build.vertexFiles = vertexSource.fileList();
+        build.fragmentFiles = fragmentSource.fileList();
+        // Partial sources would fail with confusing compile errors, or link and land in the binary cache
+        if (!vertexLoaded || !fragmentLoaded) {
+            build.sourceMissing = true;
+            return build;
+        }
+        // Reuse a previously linked binary when the program cache is enabled
+        build.cachePath = binaryCachePath(vertexSource, fragmentSource);
+        if (!build.cachePath.empty()) {
+            build.program = loadProgramBinary(build.cachePath);
+            build.fromBinary = build.program != 0;
+            if (build.fromBinary) {
+                binaryCacheStats().hits++;
+                return build;
+            }
+            binaryCacheStats().misses++;
+        }
+
+        // Vertex shader
+        build.vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(build.vertex, (GLsizei)vertexSource.strings.size(), vertexSource.strings.data(), vertexSource.lengths.data());
+        glCompileShader(build.vertex);
+
+        // Fragment shader
+        build.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(build.fragment, (GLsizei)fragmentSource.strings.size(), fragmentSource.strings.data(), fragmentSource.lengths.data());
+        glCompileShader(build.fragment);
+
+        // Shader program
+        build.program = glCreateProgram();
+        glAttachShader(build.program, build.vertex);
+        glAttachShader(build.program, build.fragment);
+        if (!build.cachePath.empty())
+            glext::ProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(build.program);
+        return build;
+    }
+
+    // True once querying the build's status will not block
+    bool buildCompleted(const Build &build) const {
+        if (build.sourceMissing || build.fromBinary || !glext::parallelShaderCompileSupported())
+            return true;
+        GLint done = GL_FALSE;
+        glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+
+    // Check compile and link status now that the driver is done. Returns whether the program linked
+    // ------------------------------------------------------------------------
+    bool finishBuild(Build &build) {
+        if (build.sourceMissing) {
+            std::cout << "ERROR::SHADER::SOURCE_NOT_LOADED: " << vertexPath << " (" << build.vertexFiles << "), "
+                      << fragmentPath << " (" << build.fragmentFiles << ")" << std::endl;
+            return false;
+        }
+        if (build.fromBinary)
+            return true;
+        bool success = true;
+        if (!checkCompileErrors(build.vertex, "VERTEX")) {
+            std::cout << "Source strings: " << build.vertexFiles << std::endl;
+            success = false;
+        }
+        if (!checkCompileErrors(build.fragment, "FRAGMENT")) {
+            std::cout << "Source strings: " << build.fragmentFiles << std::endl;
+            success = false;
+        }
+        success = checkCompileErrors(build.program, "PROGRAM") && success;
+
+        // Delete the shaders as they're now linked into program
+        glDeleteShader(build.vertex);
+        glDeleteShader(build.fragment);
+        build.vertex = build.fragment = 0;
+
+        if (success && !build.cachePath.empty())
+            saveProgramBinary(build.program, build.cachePath);
+        return success;
+    }
+
+    static std::string &binaryCacheDirectory() {
+        static std::string directory;
+        return directory;
+    }
+
+    // Program binary cache entries start with this header, followed by the driver's binary blob
+    struct BinaryHeader {
+        uint32_t magic;
+        uint32_t format;
+        uint32_t length;
+        uint32_t reserved;
+        uint64_t key;
+    };
+    static constexpr uint32_t BINARY_MAGIC = 0x42505448; // "HTPB"
+
+    // Cache file for these sources on the current driver, or empty when caching is off or unsupported.
+    // The key covers the assembled sources (includes and defines expanded) and GL_RENDERER/GL_VERSION,
+    // so edits to any included file or a driver update miss cleanly
+    // ------------------------------------------------------------------------
+    std::string binaryCachePath(const ShaderSource &vertexSource, const ShaderSource &fragmentSource) {
+        if (binaryCacheDirectory().empty() || !glext::programBinarySupported())
+            return "";
+        const char *renderer = (const char*)glGetString(GL_RENDERER);
+        const char *version = (const char*)glGetString(GL_VERSION);
+        uint64_t key = vertexSource.hash(14695981039346656037ull);
+        key = fragmentSource.hash(key);
+        key = hashBytes64(renderer, strlen(renderer) + 1, key);
+        key = hashBytes64(version, strlen(version) + 1, key);
+        binaryKey = key;
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return binaryCacheDirectory() + "/" + name;
+    }
+    uint64_t binaryKey = 0;
+
+    // Returns 0 when the entry is missing, corrupt or rejected by the driver
+    // ------------------------------------------------------------------------
+    GLuint loadProgramBinary(const std::string &path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return 0;
+        BinaryHeader header;
+        if (!file.read((char*)&header, sizeof(header)) || header.magic != BINARY_MAGIC || header.key != binaryKey)
+            return 0;
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), binary.size()))
+            return 0;
+
+        GLuint program = glCreateProgram();
+        glext::ProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            // Stale binary (driver changed underneath us): fall back to compiling from source
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    // Write to a temporary file and rename it over the entry so readers never see a partial binary
+    // ------------------------------------------------------------------------
+    void saveProgramBinary(GLuint program, const std::string &path) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glext::GetProgramBinary(program, length, &length, &format, binary.data());
+        BinaryHeader header = { BINARY_MAGIC, format, (uint32_t)length, 0, binaryKey };
+
+        std::error_code error;
+        std::filesystem::create_directories(binaryCacheDirectory(), error);
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file.write((const char*)&header, sizeof(header)) || !file.write(binary.data(), length))
+                return;
+        }
+        std::filesystem::rename(tempPath, path, error);
+        if (error)
+            std::filesystem::remove(tempPath, error);
+    }
+
+    // Point every active uniform block with a registered name at its shared binding
+    // ------------------------------------------------------------------------
+    void bindUniformBlocks() {
+        GLint count = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        for (GLint i = 0; i < count; i++) {
+            GLchar name[256];
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(ID, (GLuint)i, sizeof(name), &length, name);
+            uint32_t hash = hashBytes(name, length);
+            for (const BlockBinding &block : blockBindings()) {
+                if (block.hash == hash)
+                    glUniformBlockBinding(ID, (GLuint)i, block.binding);
+            }
+        }
+    }
+
+    // Enumerate active uniforms once after linking so setters never query GL for locations
+    // ------------------------------------------------------------------------
+    void buildUniformTable() {
+        // Keep existing slots (and their cached values); uniforms no longer active lose their location
+        for (UniformInfo &info : uniforms)
+            info.location = -1;
+        uniformAliases.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> nameBuffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+            std::string name(nameBuffer.data(), length);
+            GLint loc = glGetUniformLocation(ID, name.c_str());
+            // Members of uniform blocks have no location
+            if (loc < 0)
+                continue;
+            if (size == 1 && name.back() != ']') {
+                addUniform(name, loc, type);
+                continue;
+            }
+            // Arrays are reported as "name[0]", register every element and the bare name as element 0
+            std::string base = name.substr(0, name.rfind('['));
+            for (GLint element = 0; element < size; element++) {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                int slot = addUniform(elementName, element ? glGetUniformLocation(ID, elementName.c_str()) : loc, type);
+                if (element == 0 && slot >= 0)
+                    uniformAliases.push_back(UniformAlias{ hashString(base.c_str()), slot, base });
+            }
+        }
+
+        size_t capacity = 8;
+        while (capacity < (uniforms.size() + uniformAliases.size()) * 2)
+            capacity *= 2;
+        uniformBuckets.assign(capacity, UniformBucket{ 0, -1 });
+        // Aliases go in first: a slot left over from when the bare name was not an array is shadowed
+        for (const UniformAlias &alias : uniformAliases)
+            insertBucket(alias.hash, alias.slot);
+        for (size_t slot = 0; slot < uniforms.size(); slot++) {
+            const UniformInfo &info = uniforms[slot];
+            if (insertBucket(info.hash, (int)slot))
+                continue;
+            for (const UniformAlias &alias : uniformAliases) {
+                if (alias.hash == info.hash && alias.name != info.name)
+                    std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION: " << alias.name << " and " << info.name << std::endl;
+            }
+        }
+    }
+    // False if the hash is already indexed
+    bool insertBucket(uint32_t hash, int slot) {
+        size_t mask = uniformBuckets.size() - 1;
+        size_t i = hash & mask;
+        for (; uniformBuckets[i].slot >= 0; i = (i + 1) & mask) {
+            if (uniformBuckets[i].hash == hash)
+                return false;
+        }
+        uniformBuckets[i] = UniformBucket{ hash, slot };
+        return true;
+    }
+    // Returns the uniform's slot, reusing the one it had before a relink, or -1 on a hash collision
+    int addUniform(const std::string &name, GLint loc, GLenum type) {
+        uint32_t hash = hashString(name.c_str());
+        for (size_t slot = 0; slot < uniforms.size(); slot++) {
+            UniformInfo &info = uniforms[slot];
+            if (info.hash == hash) {
+                if (info.name != name) {
+                    std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION: " << info.name << " and " << name << std::endl;
+                    return -1;
+                }
+                if (info.location < 0) {
+                    // Relinked: same uniform, possibly a new location or type
+                    if (info.type != type)
+                        info.kind = NoValue;
+                    info.location = loc;
+                    info.type = type;
+                }
+                return (int)slot;
+            }
+        }
+        UniformInfo info;
+        info.hash = hash;
+        info.location = loc;
+        info.type = type;
+        info.name = name;
+        info.kind = NoValue;
+        uniforms.push_back(info);
+        return (int)uniforms.size() - 1;
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type) {
+    bool checkCompileErrors(GLuint shader, std::string type) {
         GLint success;
         GLchar infoLog[1024];
         if(type != "PROGRAM") {
@@ -136,6 +667,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success == GL_TRUE;
     }
 };
 
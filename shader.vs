@@ -3,17 +3,40 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
+// Permutation defines (see shader_variants.h):
+//   INSTANCED           read the model and normal matrices from per-instance attributes instead of uniforms
+//   QUANTIZED_VERTICES  aPos is snorm16 within the mesh bounds (see vertex_format.h)
+#ifdef INSTANCED
+layout (location = 3) in mat4 aInstanceModel;
+layout (location = 7) in mat3 aInstanceNormalMatrix;
+#define MODEL aInstanceModel
+#define NORMAL_MATRIX aInstanceNormalMatrix
+#else
+uniform mat4 model;
+// Inverse-transpose of model's upper 3x3, computed on the CPU (see normal_matrix.h)
+uniform mat3 normalMatrix;
+#define MODEL model
+#define NORMAL_MATRIX normalMatrix
+#endif
+
+#ifdef QUANTIZED_VERTICES
+uniform vec3 positionCenter;
+uniform vec3 positionExtent;
+#define POSITION (aPos * positionExtent + positionCenter)
+#else
+#define POSITION aPos
+#endif
+
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "frame_data.glsl"
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    vec4 worldPos = MODEL * vec4(POSITION, 1.0);
+    gl_Position = projection * view * worldPos;
+    FragPos = vec3(worldPos);
+    Normal = NORMAL_MATRIX * aNormal;
     TexCoords = aTexCoords;
 }
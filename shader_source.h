@@ -0,0 +1,205 @@
+#ifndef SHADER_SOURCE_H
+#define SHADER_SOURCE_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "hash.h"
+
+// Source for one shader stage, ready for glShaderSource(strings.size(), strings, lengths).
+// Pieces point straight into memory mapped files; only #line and #define lines are generated
+struct ShaderSource {
+    std::vector<const GLchar*> strings;
+    std::vector<GLint> lengths;
+    // Generated pieces. A deque so earlier pointers stay valid as lines are added
+    std::deque<std::string> generated;
+    // Files in #line source string number order: files[0] is the stage's own file
+    std::vector<std::string> files;
+    bool ok = true;
+
+    void add(const char *data, size_t length) {
+        if (length == 0)
+            return;
+        strings.push_back(data);
+        lengths.push_back((GLint)length);
+    }
+    void addGenerated(const std::string &text) {
+        generated.push_back(text);
+        add(generated.back().data(), generated.back().size());
+    }
+    // Content hash of the assembled source, as if the pieces were concatenated
+    uint64_t hash(uint64_t seed) const {
+        for (size_t i = 0; i < strings.size(); i++)
+            seed = hashBytes64(strings[i], lengths[i], seed);
+        return hashBytes64("", 1, seed);
+    }
+    // "0 = shader.fs, 1 = lighting.glsl" for mapping compiler error locations back to files
+    std::string fileList() const {
+        std::string list;
+        for (size_t i = 0; i < files.size(); i++)
+            list += (i ? ", " : "") + std::to_string(i) + " = " + files[i];
+        return list;
+    }
+};
+
+// Process-wide cache of memory mapped shader files. Each file is mapped and scanned for
+// #include "..." directives once; assemble() then stitches the include graph together without
+// copying any file contents. Every file is included at most once per stage
+class ShaderSourceLoader {
+public:
+    static ShaderSourceLoader &instance() {
+        static ShaderSourceLoader loader;
+        return loader;
+    }
+    ~ShaderSourceLoader() {
+        for (auto &file : files)
+            unmap(file.second);
+    }
+
+    // Build the source for the stage in path. preamble (e.g. #define lines) goes right after #version
+    bool assemble(const std::string &path, const std::string &preamble, ShaderSource &out) {
+        const File *root = load(path);
+        out.files.push_back(path);
+        if (!root) {
+            out.ok = false;
+            return false;
+        }
+        size_t start = 0;
+        if (root->versionEnd) {
+            out.add(root->data, root->versionEnd);
+            start = root->versionEnd;
+        }
+        if (!preamble.empty()) {
+            out.addGenerated(preamble);
+            out.addGenerated("#line " + std::to_string(root->versionLine + 1) + " 0\n");
+        }
+        expand(*root, 0, start, out);
+        return out.ok;
+    }
+
+    // Drop a cached file so the next assemble() maps it again, e.g. after an edit on disk
+    void invalidate(const std::string &path) {
+        auto it = files.find(path);
+        if (it == files.end())
+            return;
+        unmap(it->second);
+        files.erase(it);
+    }
+
+private:
+    struct Include {
+        size_t lineStart;
+        size_t lineEnd;
+        int line;
+        std::string path;
+    };
+    struct File {
+        const char *data = "";
+        size_t size = 0;
+        bool mapped = false;
+        std::vector<Include> includes;
+        // Offset just past the #version line (0 when there is none) and its line number
+        size_t versionEnd = 0;
+        int versionLine = 0;
+    };
+    std::unordered_map<std::string, File> files;
+
+    const File *load(const std::string &path) {
+        auto it = files.find(path);
+        if (it != files.end())
+            return &it->second;
+
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return nullptr;
+        }
+        File file;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                file.data = static_cast<const char*>(data);
+                file.size = (size_t)info.st_size;
+                file.mapped = true;
+            }
+        }
+        close(fd);
+        scan(path, file);
+        return &(files[path] = file);
+    }
+
+    static void unmap(File &file) {
+        if (file.mapped)
+            munmap(const_cast<char*>(file.data), file.size);
+        file.mapped = false;
+    }
+
+    // Find the #version line and every #include "..." line, resolving paths relative to the file
+    static void scan(const std::string &path, File &file) {
+        size_t slash = path.rfind('/');
+        std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+        int line = 1;
+        for (size_t lineStart = 0; lineStart < file.size; line++) {
+            const char *end = static_cast<const char*>(memchr(file.data + lineStart, '\n', file.size - lineStart));
+            size_t lineEnd = end ? (size_t)(end - file.data) + 1 : file.size;
+            size_t i = lineStart;
+            while (i < lineEnd && (file.data[i] == ' ' || file.data[i] == '\t'))
+                i++;
+            std::string text(file.data + i, lineEnd - i);
+            if (text.compare(0, 8, "#version") == 0 && !file.versionEnd) {
+                file.versionEnd = lineEnd;
+                file.versionLine = line;
+            }
+            else if (text.compare(0, 8, "#include") == 0) {
+                size_t open = text.find('"');
+                size_t close = text.find('"', open + 1);
+                if (open != std::string::npos && close != std::string::npos)
+                    file.includes.push_back(Include{ lineStart, lineEnd, line, directory + text.substr(open + 1, close - open - 1) });
+            }
+            lineStart = lineEnd;
+        }
+    }
+
+    void expand(const File &file, int fileIndex, size_t start, ShaderSource &out) {
+        size_t position = start;
+        for (const Include &include : file.includes) {
+            if (include.lineStart < start)
+                continue;
+            out.add(file.data + position, include.lineStart - position);
+            position = include.lineEnd;
+
+            bool seen = false;
+            for (const std::string &name : out.files)
+                seen = seen || name == include.path;
+            if (!seen) {
+                int includeIndex = (int)out.files.size();
+                out.files.push_back(include.path);
+                const File *included = load(include.path);
+                if (!included) {
+                    out.ok = false;
+                    continue;
+                }
+                out.addGenerated("#line 1 " + std::to_string(includeIndex) + "\n");
+                expand(*included, includeIndex, 0, out);
+                // The included file may not end with a newline
+                out.addGenerated("\n");
+            }
+            out.addGenerated("#line " + std::to_string(include.line + 1) + " " + std::to_string(fileIndex) + "\n");
+        }
+        out.add(file.data + position, file.size - position);
+    }
+};
+
+#endif
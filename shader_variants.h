@@ -0,0 +1,95 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shader.h"
+
+// Feature bits understood by shader.vs and shader.fs. Bit i of a variant mask enables the i-th
+// entry of LIT_SHADER_FEATURES, so the two must stay in the same order
+enum LitShaderFeature : uint32_t {
+    FEATURE_SPECULAR_MAP = 1u << 0,
+    FEATURE_INSTANCED    = 1u << 1,
+    FEATURE_TWO_LIGHTS   = 1u << 2,
+    FEATURE_QUANTIZED    = 1u << 3,
+};
+const std::vector<std::string> LIT_SHADER_FEATURES = {
+    "SPECULAR_MAP",
+    "INSTANCED",
+    "NUM_LIGHTS 2",
+    "QUANTIZED_VERTICES",
+};
+
+// Compiled permutations of one vertex/fragment pair, keyed by feature bitmask. Variants are
+// built on first use (deferred, poll isReady()) or ahead of time with prewarm(). Each variant
+// owns its uniform table, so every user of a mask shares the same introspected locations
+class ShaderVariants {
+public:
+    ShaderVariants(const char *vertexPath, const char *fragmentPath, const std::vector<std::string> &features)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), features(features) {}
+
+    // Variant for a feature mask, submitting its build if this is the first request
+    Shader &get(uint32_t mask) {
+        auto it = variants.find(mask);
+        if (it != variants.end())
+            return *it->second;
+        std::unique_ptr<Shader> &variant = variants[mask];
+        variant.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), Shader::Deferred, definesFor(mask)));
+        return *variant;
+    }
+
+    // Submit every listed variant up front so they compile in parallel before first use
+    void prewarm(std::initializer_list<uint32_t> masks) {
+        for (uint32_t mask : masks)
+            get(mask);
+    }
+
+    // Forward hot reloads to every built variant. Each variant tracks its own #include dependencies
+    bool dependsOn(const std::string &path) const {
+        for (const auto &variant : variants) {
+            if (variant.second->dependsOn(path))
+                return true;
+        }
+        return false;
+    }
+    void reload() {
+        for (auto &variant : variants)
+            variant.second->reload();
+    }
+    Shader::ReloadStatus pollReload() {
+        Shader::ReloadStatus result = Shader::NoReload;
+        for (auto &variant : variants) {
+            Shader::ReloadStatus status = variant.second->pollReload();
+            // Report the most significant status: failures, then in-flight, then swaps
+            if (status == Shader::ReloadFailed || (status == Shader::Reloading && result != Shader::ReloadFailed) ||
+                (status == Shader::Reloaded && result == Shader::NoReload))
+                result = status;
+        }
+        return result;
+    }
+
+    size_t size() const {
+        return variants.size();
+    }
+
+private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::vector<std::string> features;
+    std::unordered_map<uint32_t, std::unique_ptr<Shader>> variants;
+
+    std::vector<std::string> definesFor(uint32_t mask) const {
+        std::vector<std::string> defines;
+        for (size_t bit = 0; bit < features.size(); bit++) {
+            if (mask & (1u << bit))
+                defines.push_back(features[bit]);
+        }
+        return defines;
+    }
+};
+
+#endif
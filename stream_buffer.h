@@ -0,0 +1,181 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "gl_ext.h"
+#include "gl_state.h"
+
+// Ring of per-frame regions in one buffer object for data written every frame (instance
+// transforms, uniform blocks). The CPU writes region i while the GPU may still read the regions of
+// the previous frames; a fence per region makes sure a region is only reused once the GPU is done
+// with it, so uploads never make the driver sync implicitly.
+//
+// With buffer storage the whole buffer stays persistently and coherently mapped. Otherwise each
+// frame's region is mapped unsynchronized (the fence already guarantees the GPU is done) and must
+// be unmapped with flush() before drawing from it.
+//
+// Per frame: beginFrame(), allocate() and write, flush(), draw, endFrame()
+class StreamBuffer {
+public:
+    unsigned int ID;
+
+    struct Allocation {
+        // Null when the region is full
+        void *data = nullptr;
+        // Byte offset into the buffer, for attribute pointers and glBindBufferRange
+        GLintptr offset = 0;
+    };
+
+    // Stall counters are never reset: any nonzero value means the CPU got ahead of the GPU by the
+    // whole ring and had to wait
+    struct Stats {
+        int frames = 0;
+        int stalls = 0;
+        double stallMs = 0.0;
+        int overflows = 0;
+        size_t bytes = 0;
+    };
+    Stats stats;
+
+    StreamBuffer(size_t regionSize, int regionCount = 3)
+        : regionSize(regionSize), regionCount(regionCount), fences(regionCount, nullptr) {
+        size_t size = regionSize * regionCount;
+        glGenBuffers(1, &ID);
+        // Bound on the copy target so no binding the renderer uses is disturbed
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+        persistent = glext::bufferStorageSupported();
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glext::BufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+            persistentData = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+            if (!persistentData) {
+                std::cout << "ERROR::STREAM_BUFFER::PERSISTENT_MAP_FAILED" << std::endl;
+                persistent = false;
+                // Storage is immutable, so start over with a mutable buffer
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+                glState().deleteBuffer(ID);
+                glGenBuffers(1, &ID);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+            }
+        }
+        if (!persistent)
+            glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        uniformAlignment = alignment > 0 ? (size_t)alignment : 256;
+    }
+    // Unmaps and deletes through GL, so it has to go while the context is still current
+    ~StreamBuffer() {
+        for (GLsync fence : fences) {
+            if (fence)
+                glDeleteSync(fence);
+        }
+        if (persistentData || regionData) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glState().deleteBuffer(ID);
+    }
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer &operator=(const StreamBuffer&) = delete;
+
+    bool isPersistent() const {
+        return persistent;
+    }
+    // Offset alignment glBindBufferRange needs for uniform blocks
+    size_t uniformOffsetAlignment() const {
+        return uniformAlignment;
+    }
+
+    // Move to the next region, waiting for the GPU to finish the frame that last used it
+    void beginFrame() {
+        region = (region + 1) % regionCount;
+        used = 0;
+        stats.frames++;
+        GLsync &fence = fences[region];
+        if (fence) {
+            // Poll first: a signaled fence is the normal case and costs no wait
+            GLenum status = glClientWaitSync(fence, 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED) {
+                auto start = std::chrono::high_resolution_clock::now();
+                do {
+                    status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                } while (status == GL_TIMEOUT_EXPIRED);
+                stats.stalls++;
+                stats.stallMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            }
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if (persistent) {
+            regionData = persistentData + regionStart();
+        }
+        else {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT;
+            regionData = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, regionStart(), regionSize, flags));
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+    }
+
+    // Space for this frame's data, until flush(). alignment must be a power of two
+    Allocation allocate(size_t size, size_t alignment = 16) {
+        Allocation allocation;
+        size_t start = (used + alignment - 1) & ~(alignment - 1);
+        if (!regionData || start + size > regionSize) {
+            stats.overflows++;
+            return allocation;
+        }
+        used = start + size;
+        stats.bytes += size;
+        allocation.offset = (GLintptr)(regionStart() + start);
+        allocation.data = regionData + start;
+        return allocation;
+    }
+
+    // End this frame's writes. Draws may read the region afterwards
+    void flush() {
+        if (persistent || !regionData)
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+        if (used)
+            glFlushMappedBufferRange(GL_COPY_WRITE_BUFFER, 0, used);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        regionData = nullptr;
+    }
+
+    // Fence the region after the frame's last draw from it
+    void endFrame() {
+        flush();
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+private:
+    size_t regionSize;
+    int regionCount;
+    int region = -1;
+    size_t used = 0;
+    std::vector<GLsync> fences;
+    bool persistent = false;
+    // The whole buffer's persistent mapping, and where the current region's writes go
+    unsigned char *persistentData = nullptr;
+    unsigned char *regionData = nullptr;
+    size_t uniformAlignment = 256;
+
+    size_t regionStart() const {
+        return regionSize * region;
+    }
+};
+
+#endif
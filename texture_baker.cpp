@@ -0,0 +1,158 @@
+// Offline texture baker: converts images (anything stb_image reads) into the KTX2-style container
+// of ktx_file.h with the whole mip chain precomputed, for loadKtxTexture() in ktx_texture.h.
+//
+// A standalone tool, not part of the app target. Build and run from the repository root:
+//
+//   c++ -std=c++17 -O2 -I. texture_baker.cpp -o texture_baker
+//   ./texture_baker -o <directory the app runs in> textures/*
+//   ./texture_baker --bc -o <directory the app runs in> textures/*
+//
+// Each input is written as <name>.ktx2 (crate.png becomes crate.ktx2) into the -o directory, or
+// next to the input without one. Channels are kept as decoded: 1 to 4 become R8 to RGBA8.
+//
+// --bc1, --bc3 or --bc7 block compress every level instead (block_compression.h), at the high
+// quality tier unless --fast is given; --bc picks BC1 for opaque images and BC7 for the rest.
+// The PSNR of level 0 against the source is printed for each.
+//
+// Mips are filtered in linear light with a Kaiser window (mipmap.h). --filter box|kaiser|lanczos
+// picks another filter, --linear filters the stored values as they are (for data such as normal
+// maps), and --coverage <cutoff> keeps the alpha-tested coverage of level 0 in every level.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ktx_file.h"
+#include "mipmap.h"
+#include "block_compression.h"
+
+// Block compression asked for on the command line
+struct BakeOptions {
+    bool compress = false;
+    // BC1 for opaque images and BC7 for the rest, unless format is forced
+    bool autoFormat = true;
+    BlockFormat format = BLOCK_BC1;
+    CompressionQuality quality = COMPRESS_HIGH;
+    MipOptions mips;
+
+    BakeOptions() {
+        mips.filter = MIP_KAISER;
+    }
+};
+
+static std::string outputPath(const std::string &input, const std::string &directory) {
+    size_t slash = input.find_last_of('/');
+    std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos)
+        name = name.substr(0, dot);
+    std::string base = directory.empty() ? (slash == std::string::npos ? "" : input.substr(0, slash + 1)) : directory + "/";
+    return base + name + ".ktx2";
+}
+
+// Replace RGBA8 levels with their blocks, returning the format used and the PSNR of level 0
+static BlockFormat compressLevels(std::vector<std::vector<unsigned char>> &levels, uint32_t width, uint32_t height,
+                                  const BakeOptions &options, double &psnr) {
+    size_t count = (size_t)width * height;
+    BlockFormat format = options.format;
+    if (options.autoFormat)
+        format = hasTranslucentTexels(levels[0].data(), count) ? BLOCK_BC7 : BLOCK_BC1;
+    for (size_t level = 0; level < levels.size(); level++) {
+        uint32_t w = ktxLevelExtent(width, (uint32_t)level), h = ktxLevelExtent(height, (uint32_t)level);
+        std::vector<unsigned char> blocks = compressImage(levels[level].data(), w, h, format, options.quality, &WorkerPool::instance());
+        if (level == 0) {
+            std::vector<unsigned char> decoded(count * 4);
+            decompressImage(blocks.data(), w, h, format, decoded.data());
+            psnr = imagePSNR(levels[0].data(), decoded.data(), count, format != BLOCK_BC1);
+        }
+        levels[level].swap(blocks);
+    }
+    return format;
+}
+
+static bool bake(const std::string &input, const std::string &output, const BakeOptions &options) {
+    int width, height, channels;
+    unsigned char *pixels = stbi_load(input.c_str(), &width, &height, &channels, options.compress ? 4 : 0);
+    if (!pixels) {
+        std::cout << "ERROR::BAKER::CANNOT_READ " << input << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    int levelChannels = options.compress ? 4 : channels;
+    std::vector<std::vector<unsigned char>> levels = generateMipChain(pixels, width, height, levelChannels, options.mips, &WorkerPool::instance());
+    stbi_image_free(pixels);
+
+    static const uint32_t formats[] = { 0, KTX_R8_UNORM, KTX_R8G8_UNORM, KTX_R8G8B8_UNORM, KTX_R8G8B8A8_UNORM };
+    static const uint32_t blockFormats[] = { KTX_BC1_RGB_UNORM, KTX_BC3_UNORM, KTX_BC7_UNORM };
+    static const char *const blockNames[] = { "BC1", "BC3", "BC7" };
+    uint32_t vkFormat = formats[channels];
+    double psnr = 0.0;
+    BlockFormat format = BLOCK_BC1;
+    if (options.compress) {
+        format = compressLevels(levels, width, height, options, psnr);
+        vkFormat = blockFormats[format];
+    }
+    if (!writeKtxFile(output, vkFormat, width, height, levels))
+        return false;
+    std::cout << input << " -> " << output << " (" << width << "x" << height << ", " << channels << " channels, "
+              << levels.size() << " levels";
+    if (options.compress)
+        std::cout << ", " << blockNames[format] << " at " << psnr << " dB PSNR";
+    std::cout << ")" << std::endl;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    std::string directory;
+    std::vector<std::string> inputs;
+    BakeOptions options;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bc") == 0) {
+            options.compress = true;
+        }
+        else if (strcmp(argv[i], "--bc1") == 0 || strcmp(argv[i], "--bc3") == 0 || strcmp(argv[i], "--bc7") == 0) {
+            options.compress = true;
+            options.autoFormat = false;
+            options.format = argv[i][4] == '1' ? BLOCK_BC1 : argv[i][4] == '3' ? BLOCK_BC3 : BLOCK_BC7;
+        }
+        else if (strcmp(argv[i], "--fast") == 0) {
+            options.quality = COMPRESS_FAST;
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            std::string filter = argv[++i];
+            options.mips.filter = filter == "box" ? MIP_BOX : filter == "lanczos" ? MIP_LANCZOS : MIP_KAISER;
+        }
+        else if (strcmp(argv[i], "--linear") == 0) {
+            options.mips.srgb = false;
+        }
+        else if (strcmp(argv[i], "--coverage") == 0 && i + 1 < argc) {
+            options.mips.preserveCoverage = true;
+            options.mips.alphaCutoff = (float)atof(argv[++i]);
+        }
+        else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (inputs.empty()) {
+        std::cout << "usage: texture_baker [-o directory] [--bc | --bc1 | --bc3 | --bc7] [--fast] [--filter box|kaiser|lanczos] "
+                     "[--linear] [--coverage cutoff] image..." << std::endl;
+        return 1;
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    int failed = 0;
+    for (const std::string &input : inputs)
+        failed += !bake(input, outputPath(input, directory), options);
+    std::chrono::duration<double, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+    std::cout << inputs.size() - failed << " baked, " << failed << " failed in " << time.count() << " ms" << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,190 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "texture_loader.h"
+
+// Shares textures between everything that uses them. Requests are keyed by canonical path, so
+// "./crate.png" and "crate.png" load once, and by a hash of the decoded pixels, so the same image
+// saved under two names is uploaded once: the second load is dropped as soon as it decodes and its
+// handles resolve to the first texture. Handles are reference counted and the texture's GPU memory
+// is freed when the last one goes.
+//
+// Loading goes through a TextureLoader, whose acceptDecoded hook the cache takes over. Only use it
+// from the GL thread, and keep it alive for as long as any of its handles
+class TextureCache {
+    struct Resource;
+
+public:
+    // Path lookups that found a live texture, those that did not, and how many of the misses turned
+    // out to decode to pixels already loaded. Bytes come from the loader
+    struct Stats {
+        int pathHits = 0;
+        int misses = 0;
+        int contentHits = 0;
+    };
+    Stats stats;
+
+    // Shared reference to a cached texture. Copies add a reference; the last one to go frees it
+    class Handle {
+    public:
+        Handle() = default;
+        Handle(const Handle &other) : cache(other.cache), resource(other.resource) {
+            if (resource)
+                resource->refs++;
+        }
+        Handle(Handle &&other) noexcept : cache(other.cache), resource(other.resource) {
+            other.resource = nullptr;
+        }
+        Handle &operator=(Handle other) {
+            std::swap(cache, other.cache);
+            std::swap(resource, other.resource);
+            return *this;
+        }
+        ~Handle() {
+            reset();
+        }
+
+        void reset() {
+            if (resource)
+                cache->release(resource);
+            resource = nullptr;
+        }
+        bool valid() const {
+            return resource != nullptr;
+        }
+        // The loader's placeholder until the texture is resident
+        GLuint texture() const {
+            return resource ? cache->loader.texture(cache->target(resource)->texture) : 0;
+        }
+        bool isResident() const {
+            return resource && cache->loader.isResident(cache->target(resource)->texture);
+        }
+
+    private:
+        friend class TextureCache;
+        TextureCache *cache = nullptr;
+        Resource *resource = nullptr;
+
+        Handle(TextureCache *cache, Resource *resource) : cache(cache), resource(resource) {}
+    };
+
+    explicit TextureCache(TextureLoader &loader) : loader(loader) {
+        loader.acceptDecoded = [this](TextureLoader::Handle texture, uint64_t contentHash) {
+            return decoded(texture, contentHash);
+        };
+    }
+    ~TextureCache() {
+        loader.acceptDecoded = nullptr;
+    }
+    TextureCache(const TextureCache&) = delete;
+    TextureCache &operator=(const TextureCache&) = delete;
+
+    Handle acquire(const std::string &path) {
+        std::string canonical = canonicalPath(path);
+        auto found = byPath.find(canonical);
+        if (found != byPath.end()) {
+            stats.pathHits++;
+            found->second->refs++;
+            return Handle(this, found->second);
+        }
+        stats.misses++;
+        Resource *resource = new Resource();
+        resource->path = canonical;
+        resource->refs = 1;
+        resource->texture = loader.request(canonical);
+        byPath[canonical] = resource;
+        decoding[resource->texture.index] = resource;
+        return Handle(this, resource);
+    }
+
+    // Distinct textures held, counting each deduplicated image once
+    size_t textureCount() const {
+        return byContent.size() + decoding.size();
+    }
+    size_t residentBytes() const {
+        return loader.stats.residentBytes;
+    }
+
+    void resetStats() {
+        stats = Stats();
+    }
+
+private:
+    struct Resource {
+        std::string path;
+        TextureLoader::Handle texture;
+        // Set when the pixels turned out to match another resource's; that one holds the texture
+        Resource *alias = nullptr;
+        uint64_t contentHash = 0;
+        bool hashed = false;
+        int refs = 0;
+    };
+
+    TextureLoader &loader;
+    std::unordered_map<std::string, Resource*> byPath;
+    std::unordered_map<uint64_t, Resource*> byContent;
+    // Resources whose pixels have not been hashed yet, by loader handle
+    std::unordered_map<int, Resource*> decoding;
+
+    static std::string canonicalPath(const std::string &path) {
+        char *resolved = realpath(path.c_str(), nullptr);
+        // Missing files still go to the loader, and fail there, under the name given
+        if (!resolved)
+            return path;
+        std::string canonical(resolved);
+        free(resolved);
+        return canonical;
+    }
+
+    Resource *target(Resource *resource) const {
+        return resource->alias ? resource->alias : resource;
+    }
+
+    bool decoded(TextureLoader::Handle texture, uint64_t contentHash) {
+        auto found = decoding.find(texture.index);
+        if (found == decoding.end())
+            return true;
+        Resource *resource = found->second;
+        decoding.erase(found);
+        auto existing = byContent.find(contentHash);
+        if (existing != byContent.end()) {
+            // Same pixels under another path: share that texture and drop this load
+            stats.contentHits++;
+            resource->alias = existing->second;
+            resource->alias->refs++;
+            resource->texture = TextureLoader::Handle();
+            return false;
+        }
+        resource->contentHash = contentHash;
+        resource->hashed = true;
+        byContent[contentHash] = resource;
+        return true;
+    }
+
+    void release(Resource *resource) {
+        if (--resource->refs > 0)
+            return;
+        byPath.erase(resource->path);
+        if (resource->alias) {
+            release(resource->alias);
+        }
+        else {
+            if (resource->hashed)
+                byContent.erase(resource->contentHash);
+            else
+                decoding.erase(resource->texture.index);
+            loader.release(resource->texture);
+        }
+        delete resource;
+    }
+};
+
+#endif
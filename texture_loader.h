@@ -0,0 +1,492 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stb_image.h"
+#include "hash.h"
+#include "gl_state.h"
+#include "stream_buffer.h"
+#include "gl_ext.h"
+#include "block_compression.h"
+#include "mipmap.h"
+
+// Loads textures without holding up the render loop. request() returns a handle at once and queues
+// the file for the decode threads, which run stb_image off the GL thread. upload(), called once per
+// frame on the GL thread, copies decoded rows into a fenced staging ring used as a pixel unpack
+// buffer and specifies the texture from there, so the driver copies asynchronously and no frame
+// moves more than uploadBudget bytes. A texture too big for one frame arrives in bands of rows
+// over several. Until a texture is resident its handle resolves to a 1x1 placeholder.
+//
+// Decode threads also hash the decoded pixels, so a layer above (see TextureCache) can spot
+// identical images through acceptDecoded before they are uploaded a second time.
+//
+// With cpuMipmaps set, decode threads also build the mip chain (mipmap.h), filtered in linear light,
+// and every level is uploaded in bands like level 0. With compress set they go on to encode it into
+// BCn blocks (block_compression.h, fast tier), and whole levels go up with glCompressedTexImage2D.
+// That is a quarter to an eighth of the upload and the VRAM, traded for CPU time off the GL thread.
+//
+// Decoding has threads of its own rather than using the WorkerPool: pool jobs are fork-join within
+// a frame, while a decode has to keep running across frames, even with no spare cores
+class TextureLoader {
+public:
+    // A requested texture; valid until released
+    struct Handle {
+        int index = -1;
+        bool valid() const { return index >= 0; }
+    };
+
+    struct Stats {
+        int requested = 0;
+        // Textures resident now, and the bytes their mip chains take as specified
+        int resident = 0;
+        size_t residentBytes = 0;
+        int failed = 0;
+        // Pixel bytes uploaded to textures
+        size_t uploadedBytes = 0;
+        // Frames that uploaded anything
+        int uploadFrames = 0;
+        // From the first request to the last texture becoming resident or failing, for the latest batch
+        double loadMs = 0.0;
+    };
+    Stats stats;
+
+    // Called on the GL thread for each image that decoded, with a hash of its size, channels and
+    // pixels, before anything is uploaded. Returning false releases the request
+    std::function<bool(Handle handle, uint64_t contentHash)> acceptDecoded;
+
+    // Upload 3- and 4-channel images block compressed: BC1 when opaque, otherwise BC3, or BC7 with
+    // bc7 set. Needs glext::s3tcSupported(), and glext::bptcSupported() for bc7. Set before the
+    // first request
+    bool compress = false;
+    bool bc7 = false;
+
+    // Build mip chains on the decode threads with generateMipChain (mipmap.h) and upload every level,
+    // rather than calling glGenerateMipmap on the GL thread. Always done when compressing. Set,
+    // along with mipOptions, before the first request
+    bool cpuMipmaps = false;
+    MipOptions mipOptions;
+
+    // uploadBudget bytes of pixels at most go to the GPU per upload(). With decodeThreads 0 there is
+    // one decode thread per core but one, and at least one
+    explicit TextureLoader(size_t uploadBudget = 4 * 1024 * 1024, unsigned int decodeThreads = 0)
+        : uploadBudget(uploadBudget), staging(uploadBudget, 3) {
+        const unsigned char grey[4] = { 128, 128, 128, 255 };
+        glGenTextures(1, &placeholder);
+        glState().bindTexture(0, placeholder);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        if (decodeThreads == 0) {
+            unsigned int cores = std::thread::hardware_concurrency();
+            decodeThreads = cores > 1 ? cores - 1 : 1;
+        }
+        for (unsigned int i = 0; i < decodeThreads; i++)
+            decoders.emplace_back([this] { decodeLoop(); });
+    }
+    // Stops the decode threads, then deletes every texture. Needs the GL context still current
+    ~TextureLoader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &decoder : decoders)
+            decoder.join();
+        for (std::unique_ptr<Entry> &entry : entries) {
+            if (entry->pixels)
+                stbi_image_free(entry->pixels);
+            if (entry->texture)
+                glState().deleteTexture(entry->texture);
+        }
+        glState().deleteTexture(placeholder);
+    }
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader &operator=(const TextureLoader&) = delete;
+
+    Handle request(const std::string &path) {
+        if (pending == 0)
+            batchStart = std::chrono::high_resolution_clock::now();
+        int index = (int)entries.size();
+        if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            entries.push_back(std::unique_ptr<Entry>());
+        }
+        entries[index].reset(new Entry());
+        Entry *entry = entries[index].get();
+        entry->index = index;
+        entry->path = path;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            decodeQueue.push_back(entry);
+        }
+        wake.notify_one();
+        stats.requested++;
+        pending++;
+        return Handle{ index };
+    }
+
+    // Free the texture, or stop loading it. The handle must not be used again
+    void release(Handle handle) {
+        Entry &entry = *entries[handle.index];
+        if (entry.state == LOADING) {
+            auto uploading = std::find(uploads.begin(), uploads.end(), &entry);
+            if (uploading != uploads.end()) {
+                uploads.erase(uploading);
+            }
+            else {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto queued = std::find(decodeQueue.begin(), decodeQueue.end(), &entry);
+                if (queued == decodeQueue.end()) {
+                    // A decode thread has it; upload() drops it when it comes back
+                    entry.released = true;
+                    return;
+                }
+                decodeQueue.erase(queued);
+            }
+        }
+        discard(entry);
+    }
+
+    // The texture once resident; the placeholder until then, or for good if loading failed
+    GLuint texture(Handle handle) const {
+        if (!handle.valid() || entries[handle.index]->state != RESIDENT)
+            return placeholder;
+        return entries[handle.index]->texture;
+    }
+    bool isResident(Handle handle) const {
+        return handle.valid() && entries[handle.index]->state == RESIDENT;
+    }
+    // Every request is resident or has failed
+    bool idle() const {
+        return pending == 0;
+    }
+
+    // Move decoded images to the GPU, up to uploadBudget bytes. Call once per frame on the GL thread
+    void upload() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            arrived.swap(decoded);
+        }
+        for (Entry *entry : arrived) {
+            if (entry->released || (entry->decoded() && acceptDecoded && !acceptDecoded(Handle{ entry->index }, entry->contentHash)))
+                discard(*entry);
+            else
+                uploads.push_back(entry);
+        }
+        arrived.clear();
+        if (uploads.empty())
+            return;
+
+        // Stage this frame's bands of rows. Storage is allocated before the unpack buffer is bound,
+        // where a null pointer still means no data
+        staging.beginFrame();
+        bands.clear();
+        size_t budget = uploadBudget;
+        for (Entry *entry : uploads) {
+            if (!entry->decoded()) {
+                std::cout << "Texture failed to load at path: " << entry->path << std::endl;
+                finish(*entry, FAILED);
+                continue;
+            }
+            if (!entry->texture)
+                allocateTexture(*entry);
+            if (!stage(*entry, budget))
+                break;
+        }
+        staging.flush();
+
+        glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.ID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (const Band &band : bands) {
+            Entry &entry = *band.entry;
+            glState().bindTexture(0, entry.texture);
+            specify(entry, band.level, band.firstRow, band.rows, (void*)band.offset);
+            stats.uploadedBytes += band.bytes;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for (const Band &band : bands) {
+            if (band.entry->state == LOADING && band.entry->uploadedLevels == band.entry->levelCount())
+                complete(*band.entry);
+        }
+        staging.endFrame();
+        stats.uploadFrames++;
+
+        uploads.erase(std::remove_if(uploads.begin(), uploads.end(), [](const Entry *entry) {
+            return entry->state == RESIDENT || entry->state == FAILED;
+        }), uploads.end());
+    }
+
+    void resetStats() {
+        stats = Stats();
+    }
+
+private:
+    enum State { LOADING, RESIDENT, FAILED, RELEASED };
+
+    struct Entry {
+        int index = 0;
+        std::string path;
+        // Set by the decode thread before it hands the entry back
+        unsigned char *pixels = nullptr;
+        int width = 0;
+        int height = 0;
+        int components = 0;
+        GLenum format = GL_RGBA;
+        uint64_t contentHash = 0;
+        // The mip chain when built on the CPU, replacing pixels: texels, or blocks when compressed
+        std::vector<std::vector<uint8_t>> levels;
+        bool compressed = false;
+        BlockFormat blockFormat = BLOCK_BC1;
+        // GL thread only from here on
+        State state = LOADING;
+        // Released while a decode thread had it
+        bool released = false;
+        GLuint texture = 0;
+        // Levels fully uploaded, and rows of the next one
+        int uploadedLevels = 0;
+        int uploadedRows = 0;
+        size_t bytes = 0;
+
+        bool decoded() const {
+            return pixels || !levels.empty();
+        }
+        // Levels to upload; without a CPU-built chain, just level 0 from pixels
+        int levelCount() const {
+            return levels.empty() ? 1 : (int)levels.size();
+        }
+        const unsigned char *levelData(int level) const {
+            return levels.empty() ? pixels : levels[level].data();
+        }
+        int levelWidth(int level) const {
+            return std::max(width >> level, 1);
+        }
+        int levelHeight(int level) const {
+            return std::max(height >> level, 1);
+        }
+    };
+    // Rows [firstRow, firstRow + rows) of a level, or the whole level of a compressed one, staged at offset
+    struct Band {
+        Entry *entry;
+        int level;
+        int firstRow;
+        int rows;
+        GLintptr offset;
+        size_t bytes;
+    };
+
+    size_t uploadBudget;
+    StreamBuffer staging;
+    GLuint placeholder = 0;
+
+    // Owned and read by the GL thread; decode threads only see the entries handed to them
+    std::vector<std::unique_ptr<Entry>> entries;
+    // Slots of released entries, reused by later requests
+    std::vector<int> freeSlots;
+    std::vector<Entry*> arrived;
+    std::vector<Entry*> uploads;
+    std::vector<Band> bands;
+    int pending = 0;
+    std::chrono::high_resolution_clock::time_point batchStart;
+
+    std::vector<std::thread> decoders;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Entry*> decodeQueue;
+    std::vector<Entry*> decoded;
+    bool stopping = false;
+
+    void decodeLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&] { return stopping || !decodeQueue.empty(); });
+            if (stopping)
+                return;
+            Entry *entry = decodeQueue.front();
+            decodeQueue.pop_front();
+            lock.unlock();
+            entry->pixels = stbi_load(entry->path.c_str(), &entry->width, &entry->height, &entry->components, 0);
+            static const GLenum formats[] = { GL_RED, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+            if (entry->pixels) {
+                entry->format = formats[entry->components];
+                uint64_t shape = (uint64_t)entry->width << 32 ^ (uint64_t)entry->height << 4 ^ (uint64_t)entry->components;
+                entry->contentHash = hashContent64(entry->pixels, (size_t)entry->width * entry->height * entry->components, shape);
+                if (compress && entry->components >= 3)
+                    compressLevels(*entry);
+                else if (cpuMipmaps)
+                    buildLevels(*entry);
+            }
+            lock.lock();
+            decoded.push_back(entry);
+        }
+    }
+
+    // On a decode thread: replace the pixels with their mip chain. Each decode thread filters its
+    // own image, leaving the worker pool to the frame
+    void buildLevels(Entry &entry) {
+        entry.levels = generateMipChain(entry.pixels, entry.width, entry.height, entry.components, mipOptions);
+        stbi_image_free(entry.pixels);
+        entry.pixels = nullptr;
+    }
+
+    // As buildLevels, with each level then encoded into blocks
+    void compressLevels(Entry &entry) {
+        size_t count = (size_t)entry.width * entry.height;
+        std::vector<uint8_t> rgba = expandToRGBA(entry.pixels, count, entry.components);
+        stbi_image_free(entry.pixels);
+        entry.pixels = nullptr;
+        entry.compressed = true;
+        entry.blockFormat = !hasTranslucentTexels(rgba.data(), count) ? BLOCK_BC1 : bc7 ? BLOCK_BC7 : BLOCK_BC3;
+        entry.levels = generateMipChain(rgba.data(), entry.width, entry.height, 4, mipOptions);
+        for (int level = 0; level < (int)entry.levels.size(); level++)
+            entry.levels[level] = compressImage(entry.levels[level].data(), entry.levelWidth(level), entry.levelHeight(level),
+                                                entry.blockFormat, COMPRESS_FAST);
+    }
+
+    static GLenum compressedFormat(BlockFormat format) {
+        switch (format) {
+            case BLOCK_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case BLOCK_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            default:        return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        }
+    }
+
+    // Specify rows of a level, or a whole compressed level, from a client pointer or an offset into
+    // the bound unpack buffer. The texture must be bound
+    void specify(const Entry &entry, int level, int firstRow, int rows, const void *data) {
+        if (entry.compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, compressedFormat(entry.blockFormat), entry.levelWidth(level), entry.levelHeight(level),
+                                   0, (GLsizei)entry.levels[level].size(), data);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, firstRow, entry.levelWidth(level), rows, entry.format, GL_UNSIGNED_BYTE, data);
+    }
+
+    // Stage as much of an entry as budget allows, level by level in bands of rows; a compressed
+    // level goes whole. False when the budget ran out first
+    bool stage(Entry &entry, size_t &budget) {
+        while (entry.uploadedLevels < entry.levelCount()) {
+            int level = entry.uploadedLevels;
+            int rowCount = entry.compressed ? 1 : entry.levelHeight(level);
+            size_t rowBytes = entry.compressed ? entry.levels[level].size() : (size_t)entry.levelWidth(level) * entry.components;
+            if (rowBytes > uploadBudget) {
+                // Not even a row fits in the staging ring: specify the level straight from client memory
+                if (budget < uploadBudget)
+                    return false;
+                glState().bindTexture(0, entry.texture);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                specify(entry, level, 0, rowCount, entry.levelData(level));
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                stats.uploadedBytes += rowBytes * rowCount;
+                entry.uploadedLevels++;
+                entry.uploadedRows = 0;
+                budget = 0;
+                if (entry.uploadedLevels == entry.levelCount())
+                    complete(entry);
+                return false;
+            }
+            int rows = std::min(rowCount - entry.uploadedRows, (int)(budget / rowBytes));
+            if (rows == 0)
+                return false;
+            StreamBuffer::Allocation allocation = staging.allocate(rows * rowBytes, 4);
+            if (!allocation.data)
+                return false;
+            memcpy(allocation.data, entry.levelData(level) + entry.uploadedRows * rowBytes, rows * rowBytes);
+            bands.push_back(Band{ &entry, level, entry.uploadedRows, rows, allocation.offset, rows * rowBytes });
+            entry.uploadedRows += rows;
+            budget -= rows * rowBytes;
+            if (entry.uploadedRows < rowCount)
+                return false;
+            entry.uploadedLevels++;
+            entry.uploadedRows = 0;
+        }
+        return true;
+    }
+
+    void allocateTexture(Entry &entry) {
+        glGenTextures(1, &entry.texture);
+        glState().bindTexture(0, entry.texture);
+        // Storage for each level up front, bands fill it in. Compressed levels are specified whole
+        for (int level = 0; !entry.compressed && level < entry.levelCount(); level++)
+            glTexImage2D(GL_TEXTURE_2D, level, entry.format, entry.levelWidth(level), entry.levelHeight(level), 0, entry.format,
+                         GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    // All rows are in: build the mips, unless they came from the CPU, and drop the decoded copy
+    void complete(Entry &entry) {
+        if (!entry.levels.empty()) {
+            for (const std::vector<uint8_t> &level : entry.levels)
+                entry.bytes += level.size();
+            std::vector<std::vector<uint8_t>>().swap(entry.levels);
+            finish(entry, RESIDENT);
+            return;
+        }
+        glState().bindTexture(0, entry.texture);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        stbi_image_free(entry.pixels);
+        entry.pixels = nullptr;
+        for (int width = entry.width, height = entry.height;; width = std::max(width / 2, 1), height = std::max(height / 2, 1)) {
+            entry.bytes += (size_t)width * height * entry.components;
+            if (width == 1 && height == 1)
+                break;
+        }
+        finish(entry, RESIDENT);
+    }
+
+    // Free everything an entry holds and recycle its slot. No decode thread may still have it
+    void discard(Entry &entry) {
+        if (entry.state == LOADING)
+            finish(entry, RELEASED);
+        if (entry.state == RESIDENT) {
+            stats.resident--;
+            stats.residentBytes -= entry.bytes;
+        }
+        if (entry.pixels)
+            stbi_image_free(entry.pixels);
+        entry.pixels = nullptr;
+        std::vector<std::vector<uint8_t>>().swap(entry.levels);
+        if (entry.texture)
+            glState().deleteTexture(entry.texture);
+        entry.texture = 0;
+        entry.state = RELEASED;
+        freeSlots.push_back(entry.index);
+    }
+
+    // A loading entry reached its final state
+    void finish(Entry &entry, State state) {
+        entry.state = state;
+        if (state == RESIDENT) {
+            stats.resident++;
+            stats.residentBytes += entry.bytes;
+        }
+        else if (state == FAILED) {
+            stats.failed++;
+        }
+        if (--pending == 0)
+            stats.loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - batchStart).count();
+    }
+};
+
+#endif
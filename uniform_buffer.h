@@ -0,0 +1,76 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstring>
+
+#include "gl_state.h"
+#include "stream_buffer.h"
+
+// Binding points shared by every program. Shader binds blocks to these by name at link time
+const GLuint FRAME_DATA_BINDING = 0;
+
+// C++ mirror of the std140 FrameData block declared in frame_data.glsl.
+// vec3 members are padded to vec4 by std140, so viewPos is stored as a vec4
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 viewPos;
+};
+static_assert(offsetof(FrameData, projection) == 0,   "std140: projection at offset 0");
+static_assert(offsetof(FrameData, view)       == 64,  "std140: view at offset 64");
+static_assert(offsetof(FrameData, viewPos)    == 128, "std140: viewPos at offset 128");
+static_assert(sizeof(FrameData) == 144, "std140: FrameData block is 144 bytes");
+
+// A uniform buffer object bound to a fixed binding point, updated with one upload per frame
+template <typename T>
+class UniformBuffer {
+public:
+    unsigned int ID;
+    GLuint binding;
+
+    explicit UniformBuffer(GLuint bindingPoint) : binding(bindingPoint) {
+        glGenBuffers(1, &ID);
+        glState().bindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+        // Also binds the generic GL_UNIFORM_BUFFER point, to the buffer already bound there
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+    ~UniformBuffer() {
+        glState().deleteBuffer(ID);
+    }
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer &operator=(const UniformBuffer&) = delete;
+
+    // Replace the whole block contents
+    void update(const T &data) {
+        if (streamed) {
+            glState().bindBufferRange(GL_UNIFORM_BUFFER, binding, ID, 0, sizeof(T));
+            streamed = false;
+        }
+        glState().bindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+    }
+
+    // Write the block into this frame's region of a stream buffer and bind that range instead,
+    // so the update never waits on draws still reading last frame's contents
+    void update(const T &data, StreamBuffer &stream) {
+        StreamBuffer::Allocation allocation = stream.allocate(sizeof(T), stream.uniformOffsetAlignment());
+        if (!allocation.data) {
+            update(data);
+            return;
+        }
+        memcpy(allocation.data, &data, sizeof(T));
+        glState().bindBufferRange(GL_UNIFORM_BUFFER, binding, stream.ID, allocation.offset, sizeof(T));
+        streamed = true;
+    }
+
+private:
+    // The binding point currently refers to a stream buffer range rather than ID
+    bool streamed = false;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// How a mesh's vertices are stored on the GPU
+enum VertexFormat {
+    // 8 floats, 32 bytes (Vertex in mesh.h)
+    VERTEX_FLOAT,
+    // 16 bytes (QuantizedVertex): shader.vs needs the QUANTIZED_VERTICES define and the mesh bounds
+    VERTEX_QUANTIZED,
+};
+
+// Quantized vertex. Positions are snorm16 within the mesh bounds, which for a bounded mesh beats
+// half floats (uniform 1/65535-of-extent steps instead of precision that drops away from the
+// origin). Normals are signed 10:10:10:2, which the vertex fetch unpacks for free. UVs are unorm16
+struct QuantizedVertex {
+    // xyz plus padding to keep the next attribute 4-byte aligned
+    int16_t position[4];
+    uint32_t normal;
+    uint16_t texCoords[2];
+};
+static_assert(sizeof(QuantizedVertex) == 16, "quantized vertices are 16 bytes");
+
+// Axis-aligned box the positions are quantized to: position = snorm * extent + center
+struct MeshBounds {
+    glm::vec3 center = glm::vec3(0.0f);
+    glm::vec3 extent = glm::vec3(1.0f);
+};
+
+// Conversions follow the GL 4.2+ normalized integer rules (c / 32767, clamped to -1), which GL 3.3
+// implementations use in practice; the older (2c + 1) / 65535 rule differs by half a step at most
+inline int16_t quantizeSnorm16(float value) {
+    return (int16_t)std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f);
+}
+inline float decodeSnorm16(int16_t value) {
+    return std::max(value / 32767.0f, -1.0f);
+}
+inline uint16_t quantizeUnorm16(float value) {
+    return (uint16_t)std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f);
+}
+inline float decodeUnorm16(uint16_t value) {
+    return value / 65535.0f;
+}
+
+// GL_INT_2_10_10_10_REV: x in bits 0-9, y in 10-19, z in 20-29, w (unused) in 30-31
+inline uint32_t packNormal2101010(const glm::vec3 &normal) {
+    uint32_t packed = 0;
+    for (int i = 0; i < 3; i++) {
+        int value = (int)std::lround(std::min(std::max(normal[i], -1.0f), 1.0f) * 511.0f);
+        packed |= ((uint32_t)value & 0x3FFu) << (10 * i);
+    }
+    return packed;
+}
+inline glm::vec3 unpackNormal2101010(uint32_t packed) {
+    glm::vec3 normal;
+    for (int i = 0; i < 3; i++) {
+        // Sign-extend the 10-bit field
+        int value = (int)((packed >> (10 * i)) & 0x3FFu);
+        if (value & 0x200)
+            value -= 0x400;
+        normal[i] = std::max(value / 511.0f, -1.0f);
+    }
+    return normal;
+}
+
+template <typename V>
+MeshBounds meshBounds(const std::vector<V> &vertices) {
+    MeshBounds bounds;
+    if (vertices.empty())
+        return bounds;
+    glm::vec3 lo = vertices[0].position, hi = vertices[0].position;
+    for (const V &vertex : vertices) {
+        lo = glm::min(lo, vertex.position);
+        hi = glm::max(hi, vertex.position);
+    }
+    bounds.center = (lo + hi) * 0.5f;
+    // Flat axes still need a nonzero scale to divide by
+    bounds.extent = glm::max((hi - lo) * 0.5f, glm::vec3(1e-20f));
+    return bounds;
+}
+
+template <typename V>
+std::vector<QuantizedVertex> quantizeVertices(const std::vector<V> &vertices, const MeshBounds &bounds) {
+    std::vector<QuantizedVertex> quantized(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        glm::vec3 local = (vertices[i].position - bounds.center) / bounds.extent;
+        QuantizedVertex &out = quantized[i];
+        for (int axis = 0; axis < 3; axis++)
+            out.position[axis] = quantizeSnorm16(local[axis]);
+        out.position[3] = 0;
+        out.normal = packNormal2101010(vertices[i].normal);
+        out.texCoords[0] = quantizeUnorm16(vertices[i].texCoords.x);
+        out.texCoords[1] = quantizeUnorm16(vertices[i].texCoords.y);
+    }
+    return quantized;
+}
+
+// Worst decode error over a mesh: position in world units, normal as an angle in degrees, UV in
+// texture coordinates (UVs outside [0, 1] are clamped and show up here)
+struct QuantizationError {
+    float position = 0.0f;
+    float normalDegrees = 0.0f;
+    float texCoord = 0.0f;
+};
+
+template <typename V>
+QuantizationError measureQuantizationError(const std::vector<V> &vertices, const std::vector<QuantizedVertex> &quantized,
+                                           const MeshBounds &bounds) {
+    QuantizationError error;
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const QuantizedVertex &q = quantized[i];
+        glm::vec3 position = glm::vec3(decodeSnorm16(q.position[0]), decodeSnorm16(q.position[1]),
+                                       decodeSnorm16(q.position[2])) * bounds.extent + bounds.center;
+        error.position = std::max(error.position, glm::length(position - vertices[i].position));
+
+        // The shader normalizes after the normal matrix, so only the direction matters
+        glm::vec3 normal = unpackNormal2101010(q.normal);
+        float cosine = glm::dot(glm::normalize(normal), glm::normalize(vertices[i].normal));
+        float degrees = std::acos(std::min(std::max(cosine, -1.0f), 1.0f)) * 57.2957795f;
+        error.normalDegrees = std::max(error.normalDegrees, degrees);
+
+        glm::vec2 texCoords(decodeUnorm16(q.texCoords[0]), decodeUnorm16(q.texCoords[1]));
+        glm::vec2 delta = texCoords - vertices[i].texCoords;
+        error.texCoord = std::max(error.texCoord, std::max(std::abs(delta.x), std::abs(delta.y)));
+    }
+    return error;
+}
+
+template <typename V>
+void reportQuantizationError(const char *name, const std::vector<V> &vertices) {
+    MeshBounds bounds = meshBounds(vertices);
+    QuantizationError error = measureQuantizationError(vertices, quantizeVertices(vertices, bounds), bounds);
+    std::cout << "Mesh " << name << " quantized to " << sizeof(QuantizedVertex) << " bytes/vertex (from "
+              << sizeof(V) << "): max error position " << error.position << ", normal " << error.normalDegrees
+              << " deg, uv " << error.texCoord << std::endl;
+}
+
+// Attribute setup for locations 0-2 of shader.vs, for the buffer bound to GL_ARRAY_BUFFER
+inline void setVertexAttributes(VertexFormat format) {
+    if (format == VERTEX_QUANTIZED) {
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, position));
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, normal));
+        glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, texCoords));
+    }
+    else {
+        const GLsizei stride = 8 * sizeof(float);
+        // Configure vertex position attributes
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        // Configure vertex surface normal attributes
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+        // Configure vertex texture coord attributes
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+    }
+    for (GLuint location = 0; location < 3; location++)
+        glEnableVertexAttribArray(location);
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Process-wide pool of worker threads for data-parallel CPU work. The calling thread takes part in
+// every job, so a pool on a single-core machine (no workers) still runs everything, inline.
+// Jobs never touch GL: anything that needs the context goes back to the thread that owns it
+class WorkerPool {
+public:
+    static WorkerPool &instance() {
+        static WorkerPool pool;
+        return pool;
+    }
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool &operator=(const WorkerPool&) = delete;
+
+    // Workers plus the calling thread
+    size_t threadCount() const {
+        return workers.size() + 1;
+    }
+
+    // How many chunks to split count items into so each gets at least minItems, one per thread at most
+    size_t chunksFor(size_t count, size_t minItems) const {
+        size_t chunks = (count + minItems - 1) / std::max<size_t>(minItems, 1);
+        return std::min(std::max<size_t>(chunks, 1), threadCount());
+    }
+
+    // Run fn(begin, end, chunk) over [0, count) split into contiguous chunks, in parallel, and
+    // return once all have finished. Chunk i always covers the i-th slice, whichever thread runs it.
+    // Calls from inside a job run inline rather than deadlocking
+    template <typename Fn>
+    void parallelFor(size_t count, size_t chunks, Fn fn) {
+        chunks = std::max<size_t>(std::min(chunks, count), 1);
+        if (chunks == 1 || workers.empty() || insideJob()) {
+            for (size_t chunk = 0; chunk < chunks; chunk++)
+                fn(count * chunk / chunks, count * (chunk + 1) / chunks, chunk);
+            return;
+        }
+        std::lock_guard<std::mutex> submitLock(submitMutex);
+        std::unique_lock<std::mutex> lock(mutex);
+        // A worker that woke too late for the last job may still be looking at it
+        done.wait(lock, [&] { return activeWorkers == 0; });
+        job = [&](size_t chunk) { fn(count * chunk / chunks, count * (chunk + 1) / chunks, chunk); };
+        jobChunks = chunks;
+        nextChunk = 0;
+        finishedChunks = 0;
+        generation++;
+        lock.unlock();
+        wake.notify_all();
+        runChunks();
+        lock.lock();
+        done.wait(lock, [&] { return finishedChunks == jobChunks && activeWorkers == 0; });
+        job = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    // Serializes jobs submitted from different threads
+    std::mutex submitMutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::function<void(size_t)> job;
+    size_t jobChunks = 0;
+    std::atomic<size_t> nextChunk{0};
+    size_t finishedChunks = 0;
+    // Workers between picking up a job and leaving runChunks()
+    int activeWorkers = 0;
+    unsigned long generation = 0;
+    bool stopping = false;
+
+    WorkerPool() {
+        unsigned int cores = std::thread::hardware_concurrency();
+        for (unsigned int i = 1; i < cores; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    static bool &insideJob() {
+        thread_local bool inside = false;
+        return inside;
+    }
+
+    // Claim chunks of the current job until none are left
+    void runChunks() {
+        insideJob() = true;
+        size_t finished = 0;
+        for (size_t chunk = nextChunk++; chunk < jobChunks; chunk = nextChunk++) {
+            job(chunk);
+            finished++;
+        }
+        insideJob() = false;
+        if (finished) {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishedChunks += finished;
+            if (finishedChunks == jobChunks)
+                done.notify_all();
+        }
+    }
+
+    void workerLoop() {
+        unsigned long seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            activeWorkers++;
+            lock.unlock();
+            runChunks();
+            lock.lock();
+            if (--activeWorkers == 0)
+                done.notify_all();
+        }
+    }
+};
+
+#endif